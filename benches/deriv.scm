@@ -0,0 +1,20 @@
+; Gabriel deriv: symbolic differentiation, dominated by list construction
+; through map and cons.
+; expected: +
+
+(define (deriv-aux a)
+  (list '/ (deriv a) a))
+
+(define (deriv a)
+  (cond ((not (list? a)) (if (eq? a 'x) 1 0))
+        ((eq? (car a) '+) (cons '+ (map deriv (cdr a))))
+        ((eq? (car a) '-) (cons '- (map deriv (cdr a))))
+        ((eq? (car a) '*) (list '* a (cons '+ (map deriv-aux (cdr a)))))
+        (else 'error)))
+
+(define (run n result)
+  (if (eq? n 0)
+      result
+      (run (- n 1) (deriv '(+ (* 3 x x) (* a x x) (* b x) 5)))))
+
+(car (run 200 '()))
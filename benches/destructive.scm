@@ -0,0 +1,20 @@
+; Destructive list updates. The Gabriel original splices with set-cdr!;
+; here the same relinking is done by sort! and append!, which reuse the
+; existing cells instead of allocating new ones.
+; expected: 99
+
+(define (make-numbers n acc)
+  (if (eq? n 0)
+      acc
+      (make-numbers (- n 1) (cons (% (* n 37) 100) acc))))
+
+(define (shuffle-and-sort l)
+  (sort! (sort! l (lambda (a b) (< (% a 7) (% b 7)))) >))
+
+(define (run n result)
+  (if (eq? n 0)
+      result
+      (run (- n 1)
+           (shuffle-and-sort (append! (make-numbers 100 '()) (make-numbers 50 '()))))))
+
+(car (run 20 '()))
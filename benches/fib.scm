@@ -0,0 +1,9 @@
+; Doubly recursive fibonacci: function call and integer allocation overhead.
+; expected: 6765
+
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+
+(fib 20)
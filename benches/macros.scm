@@ -0,0 +1,19 @@
+; Macro heavy: every call site is expanded on each evaluation, so this
+; measures expansion plus quasiquote construction.
+; expected: 2501
+
+(defmacro (my-unless c body) `(if ,c 0 ,body))
+(defmacro (my-when c body) `(if ,c ,body 0))
+(defmacro (twice x) `(+ ,x ,x))
+(defmacro (square x) `(* ,x ,x))
+
+(define (step n)
+  (+ (my-when (< n 50) (twice n))
+     (my-unless (< n 50) (square 1))))
+
+(define (run n acc)
+  (if (eq? n 0)
+      acc
+      (run (- n 1) (+ acc (step n)))))
+
+(run 100 0)
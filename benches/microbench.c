@@ -0,0 +1,339 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains microbenchmarks that drive the interpreter's internal
+   APIs directly, so a slowdown can be pinned on one subsystem. */
+
+/* Built on the host with glibc only: malloc is wrapped through the
+   __libc_ entry points to count the bytes each operation allocates. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "data.h"
+#include "dictionary.h"
+#include "environment_frame.h"
+#include "tokenizer.h"
+#include "logging.h"
+#include "serial_handler.h"
+#include "interp.h"
+#include "embed.h"
+#include "parser.h"
+#include "evaluator.h"
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+long bytes_allocated = 0;
+long malloc_calls = 0;
+
+
+void *malloc(size_t size)
+{
+  bytes_allocated += size;
+  malloc_calls++;
+  return __libc_malloc(size);
+}
+
+
+void *calloc(size_t count, size_t size)
+{
+  bytes_allocated += count * size;
+  malloc_calls++;
+  return __libc_calloc(count, size);
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+  bytes_allocated += size;
+  malloc_calls++;
+  return __libc_realloc(ptr, size);
+}
+
+
+/* Each benchmark runs its operation the given number of times and returns
+   how many operations that was, for when one iteration does several. */
+
+typedef long (*microbenchmark_t)(int iterations);
+
+
+double elapsed_ns(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e9 + (end->tv_nsec - start->tv_nsec);
+}
+
+
+void run_microbenchmark(char *name, microbenchmark_t benchmark, int iterations)
+{
+  struct timespec start, end;
+  long bytes_at_start = bytes_allocated;
+  long calls_at_start = malloc_calls;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  long ops = benchmark(iterations);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  printf("{\"microbenchmark\": \"%s\", \"ops\": %ld, \"ns_per_op\": %.1f, \"bytes_per_op\": %.1f, \"mallocs_per_op\": %.2f}\n",
+         name, ops, elapsed_ns(&start, &end) / ops,
+         (double)(bytes_allocated - bytes_at_start) / ops,
+         (double)(malloc_calls - calls_at_start) / ops);
+}
+
+
+/********************************************************************************/
+/* tokenizer                                                                    */
+/********************************************************************************/
+
+char *tokenizer_source =
+  "(define (try-it x y z)\n"
+  "  (if (nil? x)\n"
+  "      (if (nil? y) 1 0)\n"
+  "      (+ (if (ok? (car x) 1 z)\n"
+  "             (try-it (append (cdr x) y) '() (cons (car x) z))\n"
+  "             0)\n"
+  "         (try-it (cdr x) (cons (car x) y) z))))  ; nqueens\n"
+  "(string-append \"abc\" (number->string #x1F) `(a ,b ,@c))\n";
+
+
+long tokenize(int iterations)
+{
+  long tokens = 0;
+  for (int i = 0; i < iterations; i++) {
+    initialize_tokenizer(tokenizer_source);
+    while (get_token() != END_OF_FILE) {
+      consume_token();
+      tokens++;
+    }
+  }
+  return tokens;
+}
+
+
+/********************************************************************************/
+/* dictionary                                                                   */
+/********************************************************************************/
+
+#define DICTIONARY_KEYS 64
+
+char dictionary_keys[DICTIONARY_KEYS][16];
+
+
+void make_dictionary_keys(void)
+{
+  for (int i = 0; i < DICTIONARY_KEYS; i++) {
+    sprintf(dictionary_keys[i], "key-%d", i);
+  }
+}
+
+
+long dictionary_put_keys(int iterations)
+{
+  for (int i = 0; i < iterations; i++) {
+    dictionary_t *d = new_dictionary();
+    for (int k = 0; k < DICTIONARY_KEYS; k++) {
+      dictionary_put(d, dictionary_keys[k], dictionary_keys[k]);
+    }
+    clean_dictionary(d);
+    free(d);
+  }
+  return (long)iterations * DICTIONARY_KEYS;
+}
+
+
+long dictionary_get_keys(int iterations)
+{
+  dictionary_t *d = new_dictionary();
+  for (int k = 0; k < DICTIONARY_KEYS; k++) {
+    dictionary_put(d, dictionary_keys[k], dictionary_keys[k]);
+  }
+  long found = 0;
+  for (int i = 0; i < iterations; i++) {
+    for (int k = 0; k < DICTIONARY_KEYS; k++) {
+      found += dictionary_get(d, dictionary_keys[k]) != NULL;
+    }
+  }
+  clean_dictionary(d);
+  free(d);
+  return found;
+}
+
+
+/********************************************************************************/
+/* allocator                                                                    */
+/********************************************************************************/
+
+long allocate_and_release(int iterations)
+{
+  for (int i = 0; i < iterations; i++) {
+    release(cons(NULL, NULL));
+  }
+  return iterations;
+}
+
+
+long allocate_and_release_lists(int iterations)
+{
+  for (int i = 0; i < iterations; i++) {
+    data_t *l = NULL;
+    for (int k = 0; k < 16; k++) {
+      l = cons(integer_with_value(k + 100), l);
+    }
+    release(l);
+  }
+  return (long)iterations * 16;
+}
+
+
+/********************************************************************************/
+/* printer                                                                      */
+/********************************************************************************/
+
+data_t *printer_subject = NULL;
+
+
+long print_list(int iterations)
+{
+  for (int i = 0; i < iterations; i++) {
+    free(to_string(printer_subject));
+  }
+  return iterations;
+}
+
+
+/********************************************************************************/
+/* binding lookup                                                               */
+/********************************************************************************/
+
+int lookup_depth = 0;
+
+
+long find_binding_at_depth(int iterations)
+{
+  environment_frame_t *frames[lookup_depth + 1];
+  frames[0] = new_environment_frame_below(GLOBAL_ENV);
+  data_t *symbol = intern_symbol("microbench-target");
+  bind_symbol(frames[0], symbol, integer_with_value(1));
+  for (int i = 1; i <= lookup_depth; i++) {
+    frames[i] = new_environment_frame_below(frames[i - 1]);
+  }
+
+  long found = 0;
+  for (int i = 0; i < iterations; i++) {
+    found += find_binding(frames[lookup_depth], symbol) != NULL;
+  }
+
+  for (int i = lookup_depth; i >= 0; i--) {
+    go_out_of_scope(frames[i]);
+  }
+  return found;
+}
+
+
+/********************************************************************************/
+/* embedding                                                                    */
+/********************************************************************************/
+
+char *embed_source = "(define (handler request count) (cons (+ count 1) request))";
+
+
+long call_from_host(int iterations)
+{
+  char *err = NULL;
+  ms_context_t *context = ms_new_context();
+  ms_load(context, embed_source, &err);
+  ms_value_t *handler = ms_lookup(context, "handler", &err);
+  ms_value_t *arguments[2] = {ms_string(context, "GET /"), ms_int(context, 0)};
+  for (int i = 0; i < iterations; i++) {
+    ms_value_t *reply = ms_call(context, handler, 2, arguments, &err);
+    ms_release(context, reply);
+  }
+  ms_release(context, arguments[0]);
+  ms_release(context, arguments[1]);
+  ms_release(context, handler);
+  ms_free_context(context);
+  return iterations;
+}
+
+
+/********************************************************************************/
+/* typed foreign functions                                                      */
+/********************************************************************************/
+
+char *call_source = NULL;
+
+
+int remainder_of(int a, int b)
+{
+  return a % b;
+}
+
+
+/* Evaluates an already parsed call, so only the application is measured */
+
+long evaluate_call(int iterations)
+{
+  char *err = NULL;
+  ms_context_t *context = ms_new_context();
+  ms_register(context, "rem", "int(int,int)", (foreign_function_impl)&remainder_of);
+  interp_t *previous = enter_interp(context);
+  data_t *call = retain(parse(call_source, &err));
+  for (int i = 0; i < iterations; i++) {
+    release(retain(evaluate(call, GLOBAL_ENV, &err)));
+  }
+  release(call);
+  enter_interp(previous);
+  ms_free_context(context);
+  return iterations;
+}
+
+
+int main(int argc, char *argv[])
+{
+  int scale = (argc > 1) ? atoi(argv[1]) : 1;
+  if (scale < 1) {
+    scale = 1;
+  }
+
+  serial_handler_init(0);
+  log_init_logger(&serial_handler);
+  log_set_level(ERROR);
+  initialize_lisp_data_system();
+  initialize_environment();
+
+  run_microbenchmark("tokenizer", &tokenize, 2000 * scale);
+
+  make_dictionary_keys();
+  run_microbenchmark("dictionary_put", &dictionary_put_keys, 200 * scale);
+  run_microbenchmark("dictionary_get", &dictionary_get_keys, 5000 * scale);
+
+  run_microbenchmark("alloc_release", &allocate_and_release, 1000000 * scale);
+  run_microbenchmark("alloc_release_list", &allocate_and_release_lists, 50000 * scale);
+
+  printer_subject = NULL;
+  for (int k = 0; k < 16; k++) {
+    printer_subject = cons(integer_with_value(k * 1000), printer_subject);
+  }
+  retain(printer_subject);
+  run_microbenchmark("to_string", &print_list, 50000 * scale);
+  release(printer_subject);
+
+  int depths[] = {0, 4, 16, 64};
+  for (int i = 0; i < 4; i++) {
+    char name[32];
+    lookup_depth = depths[i];
+    sprintf(name, "find_binding_depth_%d", lookup_depth);
+    run_microbenchmark(name, &find_binding_at_depth, 200000 * scale);
+  }
+
+  run_microbenchmark("embed_call", &call_from_host, 200000 * scale);
+
+  call_source = "(% 1000 7)";
+  run_microbenchmark("call_primitive", &evaluate_call, 1000000 * scale);
+  call_source = "(rem 1000 7)";
+  run_microbenchmark("call_foreign", &evaluate_call, 1000000 * scale);
+
+  return 0;
+}
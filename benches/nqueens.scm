@@ -0,0 +1,27 @@
+; Gabriel nqueens: counts the solutions on an 8x8 board with list
+; manipulation and many short-lived cons cells.
+; expected: 92
+
+(define (one-to n acc)
+  (if (eq? n 0)
+      acc
+      (one-to (- n 1) (cons n acc))))
+
+(define (ok? row dist placed)
+  (cond ((nil? placed) #t)
+        ((eq? (car placed) (+ row dist)) #f)
+        ((eq? (car placed) (- row dist)) #f)
+        (else (ok? row (+ dist 1) (cdr placed)))))
+
+(define (try-it x y z)
+  (if (nil? x)
+      (if (nil? y) 1 0)
+      (+ (if (ok? (car x) 1 z)
+             (try-it (append (cdr x) y) '() (cons (car x) z))
+             0)
+         (try-it (cdr x) (cons (car x) y) z))))
+
+(define (queens n)
+  (try-it (one-to n '()) '() '()))
+
+(queens 8)
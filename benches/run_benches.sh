@@ -0,0 +1,43 @@
+#!/bin/sh
+# Runs every benchmark in this directory and writes one JSON object per
+# run to stdout. Each benchmark file names its expected result on a
+# "; expected:" line, which is checked so a wrong answer isn't mistaken
+# for a speedup.
+#
+# usage: run_benches.sh <zombielisp binary> [runs]
+
+binary="$1"
+runs="${2:-5}"
+dir=$(dirname "$0")
+status=0
+
+if [ -z "$binary" ]; then
+    echo "usage: $0 <zombielisp binary> [runs]" >&2
+    exit 2
+fi
+
+for file in "$dir"/*.scm; do
+    name=$(basename "$file" .scm)
+    expected=$(sed -n 's/^; expected: //p' "$file")
+    run=1
+    while [ "$run" -le "$runs" ]; do
+        output=$("$binary" -s -f "$file")
+        if [ $? -ne 0 ]; then
+            echo "{\"benchmark\": \"$name\", \"run\": $run, \"error\": \"exited with failure\"}"
+            status=1
+            break
+        fi
+        result=$(echo "$output" | tail -n 2 | head -n 1)
+        stats=$(echo "$output" | tail -n 1)
+        if [ "$result" = "$expected" ]; then
+            correct=true
+        else
+            correct=false
+            status=1
+        fi
+        echo "{\"benchmark\": \"$name\", \"run\": $run, \"correct\": $correct, ${stats#\{}"
+        run=$((run + 1))
+    done
+done
+
+exit $status
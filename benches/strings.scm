@@ -0,0 +1,16 @@
+; String building: a builder accumulating formatted numbers against
+; repeated string-append and substring views.
+; expected: 3902
+
+(define (build n b)
+  (if (eq? n 0)
+      (string-builder->string b)
+      (build (- n 1) (string-builder-append! b (number->string n) " "))))
+
+(define (append-all n s)
+  (if (eq? n 0)
+      s
+      (append-all (- n 1) (string-append (substring s 0 8) (number->string n)))))
+
+(define built (build 1000 (make-string-builder)))
+(+ (string-length built) (string-length (append-all 500 "abcdefghijklmnop")))
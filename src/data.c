@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include "dictionary.h"
 #include "vector.h"
 #include "environment_vector.h"
@@ -17,20 +18,104 @@
 #include "utils.h"
 #include "data.h"
 #include "logging.h"
+#include "stats.h"
+#include "heap_profile.h"
+#include "heap_check.h"
+#include "interp.h"
 
+#ifndef INITIAL_HEAP_SIZE
 #define INITIAL_HEAP_SIZE (64 * 1024)
-#define SMALL_INTEGER_CACHE_SIZE 32
+#endif
 
-data_t *small_integer_cache[SMALL_INTEGER_CACHE_SIZE];
+/* The running interpreter's heap and symbol table */
 
-data_t *heap = NULL;
-data_t *free_list = NULL;
-int total_cell_count = 0;
-int free_cell_count = 0;
-dictionary_t* interned_symbols;
+#define heap (current_interp->heap)
+#define free_list (current_interp->free_list)
+#define total_cell_count (current_interp->total_cell_count)
+#define free_cell_count (current_interp->free_cell_count)
+#define interned_symbols (current_interp->interned_symbols)
+#define small_integer_cache (current_interp->small_integer_cache)
 
-data_t *LISP_FALSE;
-data_t *LISP_TRUE;
+
+/* Each thread takes free cells from the heap a chunk at a time into a
+   buffer of its own, and frees cells into that buffer, so allocation
+   doesn't touch the shared free list, or its lock, on the fast path.  When
+   the buffer grows past two chunks, one chunk is handed back.  The buffer
+   always holds cells of the interpreter the thread is running; entering
+   another one hands them all back. */
+
+#define CELL_CHUNK 32
+
+typedef struct cell_buffer_t {
+     data_t *cells;
+     int count;
+} cell_buffer_t;
+
+static THREAD_LOCAL cell_buffer_t cell_buffer = { NULL, 0 };
+
+
+static inline void lock_heap(void)
+{
+     while (atomic_flag_test_and_set_explicit(&current_interp->heap_lock, memory_order_acquire)) {
+     }
+}
+
+
+static inline void unlock_heap(void)
+{
+     atomic_flag_clear_explicit(&current_interp->heap_lock, memory_order_release);
+}
+
+
+/* Moves up to a chunk of cells from the free list into the buffer */
+
+static void refill_cell_buffer(void)
+{
+     lock_heap();
+     data_t *first = free_list;
+     data_t *last = NULL;
+     int taken = 0;
+     for (data_t *d = first; d != NULL && taken < CELL_CHUNK; d = d->data.next) {
+          last = d;
+          taken++;
+     }
+     if (last != NULL) {
+          free_list = last->data.next;
+          free_cell_count -= taken;
+          last->data.next = cell_buffer.cells;
+          cell_buffer.cells = first;
+          cell_buffer.count += taken;
+     }
+     unlock_heap();
+}
+
+
+/* Moves the first count cells of the buffer onto the free list */
+
+static void return_cells(int count)
+{
+     if (count == 0) {
+          return;
+     }
+     data_t *first = cell_buffer.cells;
+     data_t *last = first;
+     for (int i = 1; i < count; i++) {
+          last = last->data.next;
+     }
+     cell_buffer.cells = last->data.next;
+     cell_buffer.count -= count;
+     lock_heap();
+     last->data.next = free_list;
+     free_list = first;
+     free_cell_count += count;
+     unlock_heap();
+}
+
+
+void return_cell_buffer(void)
+{
+     return_cells(cell_buffer.count);
+}
 
 
 int total_cells(void)
@@ -41,27 +126,32 @@ int total_cells(void)
 
 int cells_remaining(void)
 {
-     return free_cell_count;
+     return free_cell_count + cell_buffer.count;
 }
 
 
 int cells_allocated(void)
 {
-     return total_cell_count - free_cell_count;
+     return total_cell_count - cells_remaining();
 }
 
 
-/* Returns a cell to the free list */
+/* Returns a cell to this thread's buffer */
 
 void free_data(data_t *d)
 {
-     char * str = to_string(d);
-     log_debug_deep("Freeing a %s: %s.", type_name(type_of(d)), str);
-     free(str);
+     /* Contents may already have been released, so don't print them */
+     log_debug_deep("Freeing a %s.", type_name(type_of(d)));
+     if (heap_profiling) {
+          heap_profile_freed(d - heap, d->meta.type);
+     }
      d->meta.type = FREE_TYPE;
-     d->data.next = free_list;
-     free_list = d;
-     free_cell_count++;
+     d->data.next = cell_buffer.cells;
+     cell_buffer.cells = d;
+     cell_buffer.count++;
+     if (cell_buffer.count > 2 * CELL_CHUNK) {
+          return_cells(CELL_CHUNK);
+     }
 }
 
 
@@ -83,6 +173,49 @@ void release_macro(macro_t *m)
 }
 
 
+void release_string(string_t *s)
+{
+     if (--s->refs == 0) {
+          if (s->shared != NULL) {
+               release_string(s->shared);
+          } else {
+               free(s->chars);
+          }
+          free(s);
+     }
+}
+
+
+void release_string_builder(string_builder_t *b)
+{
+     free(b->chars);
+     free(b);
+}
+
+
+void release_record(data_t *d)
+{
+     for (int i = 0; i < d->data.record.type->number_of_fields; i++) {
+          release(d->data.record.slots[i]);
+     }
+     free(d->data.record.slots);
+}
+
+
+/* Makes every live cell permanent, so that processes forked afterwards
+   never write to them through their reference counts and the pages holding
+   them stay shared copy-on-write.  Frozen cells are never freed. */
+
+void freeze_heap(void)
+{
+     for (int i = 0; i < total_cell_count; i++) {
+          if (heap[i].meta.type != FREE_TYPE) {
+               heap[i].meta.frozen = 1;
+          }
+     }
+}
+
+
 bool is_cached_int(data_t *d)
 {
      return integerp(d) && integer_value(d) >= 0 && integer_value(d) < SMALL_INTEGER_CACHE_SIZE;
@@ -91,15 +224,18 @@ bool is_cached_int(data_t *d)
 
 bool reference_counting_exempt(data_t *d)
 {
-     return d == NULL || type_of(d) == FREE_TYPE || type_of(d) == SYMBOL_TYPE || type_of(d) == PRIMITIVE_TYPE || type_of(d) == BOOLEAN_TYPE || is_cached_int(d);
+     return d == NULL || d->meta.frozen || d->meta.refs == MAX_REFS || type_of(d) == FREE_TYPE || type_of(d) == SYMBOL_TYPE || type_of(d) == PRIMITIVE_TYPE || type_of(d) == BOOLEAN_TYPE || type_of(d) == RECORD_DESCRIPTOR_TYPE || is_cached_int(d);
 }
 
 data_t *retain(data_t *d) {
      if (!reference_counting_exempt(d)) {
+          current_interp->stats.retains++;
           d->meta.refs++;
-          char *str = to_string(d);
-          log_debug_deep("Retaining a %s: %s. Reference count now %d", type_name(type_of(d)), str, d->meta.refs);
-          free(str);
+          if (log_enabled(DEBUG_DEEP)) {
+               char *str = to_string(d);
+               log_debug_deep("Retaining a %s: %s. Reference count now %d", type_name(type_of(d)), str, d->meta.refs);
+               free(str);
+          }
      }
      return d;
 }
@@ -120,19 +256,23 @@ void release(data_t *d)
      if (reference_counting_exempt(d)) {
           return;
      }
+     current_interp->stats.releases++;
 
-     char* str = to_string(d);
-     log_debug_deep("Releasing a %s: %s", type_name(type_of(d)), str);
-     free(str);
+     if (log_enabled(DEBUG_DEEP)) {
+          char* str = to_string(d);
+          log_debug_deep("Releasing a %s: %s", type_name(type_of(d)), str);
+          free(str);
+     }
 
      if (d->meta.refs == 0 || --d->meta.refs == 0) {
-               char* str = to_string(d);
-               log_debug_deep("Reference count = 0. Freeing.", type_name(type_of(d)), str);
-               free(str);
+          log_debug_deep("Reference count = 0. Freeing.");
 
           switch (type_of(d)) {
           case STRING_TYPE:
-               free(d->data.string_data);
+               release_string(d->data.string);
+               break;
+          case STRING_BUILDER_TYPE:
+               release_string_builder(d->data.builder);
                break;
           case CONS_CELL_TYPE:
                release(car(d));
@@ -146,27 +286,55 @@ void release(data_t *d)
           case MACRO_TYPE:
                release_macro(macro_value(d));
                break;
+          case RECORD_TYPE:
+               release_record(d);
+               break;
+          case HASH_MAP_TYPE:
+               hamt_release(hash_map_root(d));
+               break;
+          case VECTOR_TYPE:
+               pvector_release(pvector_value(d));
+               break;
           default:
                break;
           }
 
           free_data(d);
      } else {
-          char* str = to_string(d);
-          log_debug_deep("Decremented ref count of a %s: %s Now %d.", type_name(type_of(d)), str, d->meta.refs);
-          free(str);
+          if (log_enabled(DEBUG_DEEP)) {
+               char* str = to_string(d);
+               log_debug_deep("Decremented ref count of a %s: %s Now %d.", type_name(type_of(d)), str, d->meta.refs);
+               free(str);
+          }
      }
 }
 
 
+/* Drops a reference held by the caller without freeing the cell, so a
+   value that was kept alive across a computation can be returned as an
+   unreferenced result. */
+
+data_t *disown(data_t *d)
+{
+     if (!reference_counting_exempt(d) && d->meta.refs > 0) {
+          d->meta.refs--;
+     }
+     return d;
+}
+
+
 bool unreferencedp(data_t *d)
 {
-     return !freep(d) && d->meta.refs == 0;
+     return d != NULL && !freep(d) && d->meta.refs == 0;
 }
 
 
 void dump_node(data_t* d, int node_index)
 {
+     if (d == NULL) {
+          printf("nil\n");
+          return;
+     }
      printf("Node %d\n", node_index);
      if (freep(d)) {
           printf("  free\n");
@@ -175,6 +343,10 @@ void dump_node(data_t* d, int node_index)
           char *str = to_string(d);
           printf("  %s - %s\n", type_name(type_of(d)), str);
           free(str);
+          char *site = allocation_site_of(d - heap);
+          if (site != NULL) {
+               printf("  allocated in %s\n", site);
+          }
      }
 }
 
@@ -192,7 +364,100 @@ void dump_active_heap(void)
 
 int heap_index(data_t* d)
 {
-     return (d - heap) / sizeof(data_t);
+     return d - heap;
+}
+
+
+data_t *heap_cell(int index)
+{
+     return &heap[index];
+}
+
+
+bool in_heap(data_t *d)
+{
+     return d >= heap && d < heap + total_cell_count;
+}
+
+
+data_t *free_list_head(void)
+{
+     return free_list;
+}
+
+
+/* Calls visitor on every cell d holds a reference to, including those
+   reached through function, record, map and vector structures outside the
+   heap.  Environment frames are not followed; walk those separately. */
+
+typedef struct reference_visit_t {
+     reference_visitor_t visitor;
+     void *context;
+} reference_visit_t;
+
+
+void visit_map_entry(data_t *key, data_t *value, void *context)
+{
+     reference_visit_t *visit = (reference_visit_t*)context;
+     visit->visitor(key, visit->context);
+     visit->visitor(value, visit->context);
+}
+
+
+void for_each_reference(data_t *d, reference_visitor_t visitor, void *context)
+{
+     switch (type_of(d)) {
+     case CONS_CELL_TYPE:
+          visitor(d->data.pair.car_ptr, context);
+          visitor(d->data.pair.cdr_ptr, context);
+          break;
+     case FUNCTION_TYPE:
+          visitor(d->data.func->parameters, context);
+          visitor(d->data.func->body, context);
+          break;
+     case MACRO_TYPE:
+          visitor(d->data.macro->parameters, context);
+          visitor(d->data.macro->body, context);
+          break;
+     case RECORD_TYPE:
+          for (int i = 0; i < d->data.record.type->number_of_fields; i++) {
+               visitor(d->data.record.slots[i], context);
+          }
+          break;
+     case RECORD_DESCRIPTOR_TYPE:
+          for (int i = 0; i < d->data.record_type->number_of_fields; i++) {
+               visitor(d->data.record_type->field_names[i], context);
+          }
+          break;
+     case HASH_MAP_TYPE:
+          {
+               reference_visit_t visit = {visitor, context};
+               hamt_for_each(d->data.hash_map.root, &visit_map_entry, &visit);
+          }
+          break;
+     case VECTOR_TYPE:
+          for (int i = 0; i < d->data.vector->count; i++) {
+               visitor(pvector_ref(d->data.vector, i), context);
+          }
+          break;
+     default:
+          break;
+     }
+}
+
+
+/* Cells the data system itself holds on to for the life of the program */
+
+void for_each_permanent_cell(reference_visitor_t visitor, void *context)
+{
+     visitor(LISP_TRUE, context);
+     visitor(LISP_FALSE, context);
+     for (int i = 0; i < SMALL_INTEGER_CACHE_SIZE; i++) {
+          visitor(small_integer_cache[i], context);
+     }
+     for (DNODE *node = interned_symbols->start; node != NULL; node = node->next) {
+          visitor((data_t*)node->data, context);
+     }
 }
 
 /* void gc(void) */
@@ -246,15 +511,32 @@ data_t *alloc_data(__uint8_t the_type)
 
      log_debug_deep("Allocating a %s. ", type_name(the_type));
 
-     if (free_list == NULL) {
-          log_critical("Could not allocate data object");
-          exit(-1);
+#ifdef DEBUG_TRACE
+     /* Checked before the cell is taken, while its contents are still a
+        free list link */
+     if (heap_check_interval > 0) {
+          periodic_heap_check();
+     }
+#endif
+
+     if (cell_buffer.cells == NULL) {
+          refill_cell_buffer();
+          if (cell_buffer.cells == NULL) {
+               log_critical("Could not allocate data object");
+               exit(-1);
+          }
      }
-     data_t *d = free_list;
+     data_t *d = cell_buffer.cells;
+     cell_buffer.cells = d->data.next;
+     cell_buffer.count--;
      d->meta.type = the_type;
      d->meta.refs = 0;
-     free_list = free_list->data.next;
-     free_cell_count--;
+     d->meta.line = 0;
+     d->meta.frozen = 0;
+     current_interp->stats.cells_allocated[the_type]++;
+     if (heap_profiling) {
+          heap_profile_allocated(d - heap, the_type);
+     }
      return d;
 }
 
@@ -356,6 +638,11 @@ char *type_name(int type_number)
      case FUNCTION_TYPE:         return "func";
      case MACRO_TYPE:            return "mac";
      case PRIMITIVE_TYPE:        return "prim";
+     case RECORD_TYPE:           return "rec";
+     case RECORD_DESCRIPTOR_TYPE: return "rtd";
+     case STRING_BUILDER_TYPE:   return "sb";
+     case HASH_MAP_TYPE:         return "map";
+     case VECTOR_TYPE:           return "vec";
      default:                    return "??";
      }
 }
@@ -428,6 +715,18 @@ primitive_function_t *make_primitive_function(char *name, int parameter_count, b
      prim->number_of_parameters = parameter_count;
      prim->special_form = special;
      prim->impl = impl;
+     prim->context_impl = NULL;
+     prim->context = NULL;
+     prim->foreign = NULL;
+     return prim;
+}
+
+
+primitive_function_t *make_primitive_function_with_context(char *name, int parameter_count, primitive_function_with_context_impl impl, void *context)
+{
+     primitive_function_t *prim = make_primitive_function(name, parameter_count, false, NULL);
+     prim->context_impl = impl;
+     prim->context = context;
      return prim;
 }
 
@@ -516,14 +815,247 @@ macro_t *macro_value(data_t* d)
 }
 
 
-data_t *string_with_value(char *value)
+/* Record types are never freed: the procedures generated for them hold
+   on to the descriptor. */
+
+record_type_t *make_record_type(char *name, data_t *field_names)
+{
+     record_type_t *type = (record_type_t *)malloc(sizeof(record_type_t));
+     type->name = name;
+     type->number_of_fields = length_of(field_names);
+     type->field_names = (data_t **)malloc(type->number_of_fields * sizeof(data_t*));
+     int i = 0;
+     for (data_t *cell = field_names; cell != NULL; cell = cdr(cell)) {
+          type->field_names[i++] = car(cell);
+     }
+     return type;
+}
+
+
+data_t *record_type_with_value(record_type_t *type)
+{
+     data_t *d = alloc_data(RECORD_DESCRIPTOR_TYPE);
+     d->data.record_type = type;
+     return d;
+}
+
+
+record_type_t *record_type_value(data_t *d)
+{
+     if (type_of(d) != RECORD_DESCRIPTOR_TYPE) {
+          return NULL;
+     } else {
+          return d->data.record_type;
+     }
+}
+
+
+data_t *record_with_type(record_type_t *type)
+{
+     data_t *d = alloc_data(RECORD_TYPE);
+     d->data.record.type = type;
+     d->data.record.slots = (data_t **)calloc(type->number_of_fields, sizeof(data_t*));
+     return d;
+}
+
+
+record_type_t *record_type_of(data_t *d)
+{
+     if (type_of(d) != RECORD_TYPE) {
+          return NULL;
+     } else {
+          return d->data.record.type;
+     }
+}
+
+
+/* Persistent maps and vectors own the root they are given */
+
+data_t *hash_map_with_root(hamt_node_t *root, int count)
+{
+     data_t *d = alloc_data(HASH_MAP_TYPE);
+     d->data.hash_map.root = root;
+     d->data.hash_map.count = count;
+     return d;
+}
+
+
+hamt_node_t *hash_map_root(data_t *d)
+{
+     if (type_of(d) != HASH_MAP_TYPE) {
+          return NULL;
+     } else {
+          return d->data.hash_map.root;
+     }
+}
+
+
+int hash_map_count(data_t *d)
+{
+     if (type_of(d) != HASH_MAP_TYPE) {
+          return 0;
+     } else {
+          return d->data.hash_map.count;
+     }
+}
+
+
+data_t *pvector_with_value(pvector_t *v)
+{
+     data_t *d = alloc_data(VECTOR_TYPE);
+     d->data.vector = v;
+     return d;
+}
+
+
+pvector_t *pvector_value(data_t *d)
+{
+     if (type_of(d) != VECTOR_TYPE) {
+          return NULL;
+     } else {
+          return d->data.vector;
+     }
+}
+
+
+/* Swaps the contents of a vector cell for destructive operations such as
+   sort!. Other vectors sharing structure with the old value are unaffected. */
+
+void set_pvector_value(data_t *d, pvector_t *v)
+{
+     if (type_of(d) == VECTOR_TYPE) {
+          pvector_t *old = d->data.vector;
+          d->data.vector = v;
+          pvector_release(old);
+     }
+}
+
+
+/* Substrings shorter than this are copied rather than pinning the
+   characters of a possibly much larger string. */
+
+#define SUBSTRING_COPY_THRESHOLD 16
+
+
+data_t *string_cell_with(string_t *s)
 {
      data_t *d = alloc_data(STRING_TYPE);
-     d->data.string_data = value;
+     d->data.string = s;
      return d;
 }
 
 
+/* Takes ownership of value, which must be NUL terminated */
+
+data_t *string_with_length(char *value, int length)
+{
+     string_t *s = (string_t*)malloc(sizeof(string_t));
+     s->refs = 1;
+     s->length = length;
+     s->chars = value;
+     s->shared = NULL;
+     return string_cell_with(s);
+}
+
+
+data_t *string_with_value(char *value)
+{
+     return string_with_length(value, strlen(value));
+}
+
+
+data_t *substring_of(data_t *d, int start, int end)
+{
+     string_t *source = d->data.string;
+     int length = end - start;
+     if (length < SUBSTRING_COPY_THRESHOLD) {
+          char *chars = (char*)malloc((length + 1) * sizeof(char));
+          memcpy(chars, source->chars + start, length);
+          chars[length] = 0;
+          return string_with_length(chars, length);
+     }
+     string_t *owner = (source->shared != NULL) ? source->shared : source;
+     owner->refs++;
+     string_t *s = (string_t*)malloc(sizeof(string_t));
+     s->refs = 1;
+     s->length = length;
+     s->chars = source->chars + start;
+     s->shared = owner;
+     return string_cell_with(s);
+}
+
+
+char *string_chars(data_t *d)
+{
+     return d->data.string->chars;
+}
+
+
+int string_length(data_t *d)
+{
+     if (d->meta.type != STRING_TYPE) {
+          return 0;
+     }
+     return d->data.string->length;
+}
+
+
+/* A view is given its own NUL terminated copy of its characters the first
+   time something needs them as a C string. */
+
+void unshare_string(string_t *s)
+{
+     char *chars = (char*)malloc((s->length + 1) * sizeof(char));
+     memcpy(chars, s->chars, s->length);
+     chars[s->length] = 0;
+     release_string(s->shared);
+     s->shared = NULL;
+     s->chars = chars;
+}
+
+
+#define STRING_BUILDER_MINIMUM_CAPACITY 32
+
+
+data_t *string_builder_with_capacity(int capacity)
+{
+     if (capacity < STRING_BUILDER_MINIMUM_CAPACITY) {
+          capacity = STRING_BUILDER_MINIMUM_CAPACITY;
+     }
+     string_builder_t *b = (string_builder_t*)malloc(sizeof(string_builder_t));
+     b->length = 0;
+     b->capacity = capacity;
+     b->chars = (char*)malloc(capacity * sizeof(char));
+     data_t *d = alloc_data(STRING_BUILDER_TYPE);
+     d->data.builder = b;
+     return d;
+}
+
+
+string_builder_t *string_builder_value(data_t *d)
+{
+     if (type_of(d) != STRING_BUILDER_TYPE) {
+          return NULL;
+     } else {
+          return d->data.builder;
+     }
+}
+
+
+void string_builder_append(data_t *d, char *chars, int length)
+{
+     string_builder_t *b = d->data.builder;
+     if (b->length + length > b->capacity) {
+          while (b->length + length > b->capacity) {
+               b->capacity *= 2;
+          }
+          b->chars = (char*)realloc(b->chars, b->capacity * sizeof(char));
+     }
+     memcpy(b->chars + b->length, chars, length);
+     b->length += length;
+}
+
+
 data_t *empty_cons(void)
 {
      data_t *d = alloc_data(CONS_CELL_TYPE);
@@ -579,10 +1111,15 @@ int length_of(data_t *d)
 
 char *string_value(data_t *d)
 {
-     if (d->meta.type != STRING_TYPE && d->meta.type != SYMBOL_TYPE) {
-          return "";
-     } else {
+     if (d->meta.type == SYMBOL_TYPE) {
           return d->data.string_data;
+     } else if (d->meta.type == STRING_TYPE) {
+          if (d->data.string->shared != NULL) {
+               unshare_string(d->data.string);
+          }
+          return d->data.string->chars;
+     } else {
+          return "";
      }
 }
 
@@ -648,18 +1185,35 @@ char *list_to_string(data_t *d)
           log_error("Self referential cons");
           debug_point();
      }
-     char **strings = (char**)malloc(length_of(d) * sizeof(char**));
+     int count = 0;
+     data_t *cell;
+     for (cell = d; type_of(cell) == CONS_CELL_TYPE; cell = cdr(cell)) {
+          count++;
+     }
+     /* An improper list ends in a non-list tail, printed after a dot */
+     data_t *tail = cell;
+
+     char **strings = (char**)malloc((count + 1) * sizeof(char**));
      int len = 3;
      int index = 0;
-     for (data_t *cell = d; cell != NULL; cell = cdr(cell)) {
+     for (cell = d; type_of(cell) == CONS_CELL_TYPE; cell = cdr(cell)) {
           char *s = to_string(car(cell));
           strings[index++] = s;
           len += strlen(s) + 1;
      }
+     if (tail != NULL) {
+          char *s = to_string(tail);
+          strings[index++] = s;
+          len += strlen(s) + 3;
+     }
      char *buf = (char*)malloc(len * sizeof(char));
      buf[0] = '(';
      int offset = 1;
-     for (int i = 0; i < length_of(d); i++) {
+     for (int i = 0; i < index; i++) {
+          if (i == count) {
+               strcpy(buf + offset, ". ");
+               offset += 2;
+          }
           strcpy(buf + offset, strings[i]);
           offset += strlen(strings[i]) + 1;
           buf[offset-1] = ' ';
@@ -676,6 +1230,10 @@ char *int_to_string(data_t *d)
 {
      int digits = 2;
      int temp = integer_value(d);
+     if (temp < 0) {
+          digits++;
+          temp = -temp;
+     }
      while (temp > 0) {
           digits++;
           temp /= 10;
@@ -704,8 +1262,20 @@ char *bool_to_string(data_t *d)
 
 char *string_to_string(data_t *d)
 {
-     char *buf = (char*)malloc((strlen(string_value(d)) + 3) * sizeof(char));
-     sprintf(buf, "\"%s\"", string_value(d));
+     int length = string_length(d);
+     char *buf = (char*)malloc((length + 3) * sizeof(char));
+     buf[0] = '"';
+     memcpy(buf + 1, string_chars(d), length);
+     buf[length + 1] = '"';
+     buf[length + 2] = 0;
+     return buf;
+}
+
+
+char *string_builder_to_string(data_t *d)
+{
+     char *buf = (char*)malloc(32 * sizeof(char));
+     sprintf(buf, "<string-builder: %d>", string_builder_value(d)->length);
      return buf;
 }
 
@@ -737,6 +1307,110 @@ char *prim_to_string(data_t *d)
 }
 
 
+void append_chars(char **buf, int *length, int *capacity, char *s)
+{
+     int s_length = strlen(s);
+     if (*length + s_length + 1 > *capacity) {
+          while (*length + s_length + 1 > *capacity) {
+               *capacity *= 2;
+          }
+          *buf = (char*)realloc(*buf, *capacity * sizeof(char));
+     }
+     memcpy(*buf + *length, s, s_length + 1);
+     *length += s_length;
+}
+
+
+typedef struct {
+     char *buf;
+     int length;
+     int capacity;
+     bool first;
+} map_printer_t;
+
+
+void print_map_entry(data_t *key, data_t *value, void *context)
+{
+     map_printer_t *printer = (map_printer_t*)context;
+     if (!printer->first) {
+          append_chars(&printer->buf, &printer->length, &printer->capacity, ", ");
+     }
+     printer->first = false;
+     char *str = to_string(key);
+     append_chars(&printer->buf, &printer->length, &printer->capacity, str);
+     free(str);
+     append_chars(&printer->buf, &printer->length, &printer->capacity, " ");
+     str = to_string(value);
+     append_chars(&printer->buf, &printer->length, &printer->capacity, str);
+     free(str);
+}
+
+
+char *hash_map_to_string(data_t *d)
+{
+     map_printer_t printer;
+     printer.capacity = 64;
+     printer.buf = (char*)malloc(printer.capacity * sizeof(char));
+     printer.length = 0;
+     printer.first = true;
+     append_chars(&printer.buf, &printer.length, &printer.capacity, "{");
+     hamt_for_each(hash_map_root(d), &print_map_entry, &printer);
+     append_chars(&printer.buf, &printer.length, &printer.capacity, "}");
+     return printer.buf;
+}
+
+
+char *pvector_to_string(data_t *d)
+{
+     pvector_t *v = pvector_value(d);
+     int capacity = 64;
+     int length = 0;
+     char *buf = (char*)malloc(capacity * sizeof(char));
+     append_chars(&buf, &length, &capacity, "[");
+     for (int i = 0; i < v->count; i++) {
+          if (i > 0) {
+               append_chars(&buf, &length, &capacity, " ");
+          }
+          char *str = to_string(pvector_ref(v, i));
+          append_chars(&buf, &length, &capacity, str);
+          free(str);
+     }
+     append_chars(&buf, &length, &capacity, "]");
+     return buf;
+}
+
+
+char *record_to_string(data_t *d)
+{
+     record_type_t *type = record_type_of(d);
+     int len = strlen(type->name) + 4;
+     char **strings = (char**)malloc(type->number_of_fields * sizeof(char*));
+     for (int i = 0; i < type->number_of_fields; i++) {
+          strings[i] = to_string(d->data.record.slots[i]);
+          len += strlen(strings[i]) + 1;
+     }
+     char *buf = (char*)malloc(len * sizeof(char));
+     sprintf(buf, "<%s:", type->name);
+     for (int i = 0; i < type->number_of_fields; i++) {
+          strcat(buf, " ");
+          strcat(buf, strings[i]);
+          free(strings[i]);
+     }
+     strcat(buf, ">");
+     free(strings);
+     return buf;
+}
+
+
+char *record_type_to_string(data_t *d)
+{
+     record_type_t *type = record_type_value(d);
+     char *buf = (char*)malloc((16 + strlen(type->name)) * sizeof(char));
+     sprintf(buf, "<record-type: %s>", type->name);
+     return buf;
+}
+
+
 char *to_string(data_t *d)
 {
      if (d == NULL) {
@@ -754,11 +1428,62 @@ char *to_string(data_t *d)
      case FUNCTION_TYPE:         return func_to_string(d);
      case MACRO_TYPE:            return macro_to_string(d);
      case PRIMITIVE_TYPE:        return prim_to_string(d);
+     case RECORD_TYPE:           return record_to_string(d);
+     case RECORD_DESCRIPTOR_TYPE: return record_type_to_string(d);
+     case STRING_BUILDER_TYPE:   return string_builder_to_string(d);
+     case HASH_MAP_TYPE:         return hash_map_to_string(d);
+     case VECTOR_TYPE:           return pvector_to_string(d);
      default:                    return strdup("unknown data type");
      }
 }
 
 
+typedef struct {
+     hamt_node_t *other;
+     bool equal;
+} map_comparison_t;
+
+
+void compare_map_entry(data_t *key, data_t *value, void *context)
+{
+     map_comparison_t *comparison = (map_comparison_t*)context;
+     bool found;
+     if (comparison->equal) {
+          data_t *other_value = hamt_get(comparison->other, key, &found);
+          comparison->equal = found && is_equal(value, other_value);
+     }
+}
+
+
+bool hash_maps_equal(data_t *d, data_t *o)
+{
+     if (hash_map_count(d) != hash_map_count(o)) {
+          return false;
+     }
+     map_comparison_t comparison;
+     comparison.other = hash_map_root(o);
+     comparison.equal = true;
+     hamt_for_each(hash_map_root(d), &compare_map_entry, &comparison);
+     return comparison.equal;
+}
+
+
+bool pvectors_equal(data_t *d, data_t *o)
+{
+     pvector_t *v = pvector_value(d);
+     pvector_t *w = pvector_value(o);
+     if (v->count != w->count) {
+          return false;
+     }
+     for (int i = 0; i < v->count; i++) {
+          if (!is_equal(pvector_ref(v, i), pvector_ref(w, i))) {
+               return false;
+          }
+     }
+     return true;
+}
+
+
 bool is_equal(data_t *d, data_t *o)
 {
      if (d == o) {
@@ -793,10 +1518,12 @@ bool is_equal(data_t *d, data_t *o)
      case INTEGER_TYPE:          return integer_value(d) == integer_value(o);
      case UNSIGNED_INTEGER_TYPE: return unsigned_integer_value(d) == unsigned_integer_value(o);
      case BOOLEAN_TYPE:          return boolean_value(d) == boolean_value(o);
-     case STRING_TYPE:           return strcmp(string_value(d), string_value(o)) == 0;
+     case STRING_TYPE:           return string_length(d) == string_length(o) && memcmp(string_chars(d), string_chars(o), string_length(d)) == 0;
      case FUNCTION_TYPE:         return func_value(d) == func_value(o);
      case MACRO_TYPE:            return macro_value(d) == macro_value(o);
      case PRIMITIVE_TYPE:        return prim_value(d) == prim_value(o);
+     case HASH_MAP_TYPE:         return hash_maps_equal(d, o);
+     case VECTOR_TYPE:           return pvectors_equal(d, o);
      default:                    return false;
      }
 }
@@ -814,6 +1541,12 @@ bool freep(data_t *d)
 }
 
 
+bool string_builderp(data_t *d)
+{
+     return check_type(d, STRING_BUILDER_TYPE);
+}
+
+
 bool symbolp(data_t *d)
 {
      return check_type(d, SYMBOL_TYPE);
@@ -854,3 +1587,21 @@ bool macrop(data_t *d)
 {
      return check_type(d, MACRO_TYPE);
 }
+
+
+bool recordp(data_t *d)
+{
+     return check_type(d, RECORD_TYPE);
+}
+
+
+bool hash_mapp(data_t *d)
+{
+     return check_type(d, HASH_MAP_TYPE);
+}
+
+
+bool pvectorp(data_t *d)
+{
+     return check_type(d, VECTOR_TYPE);
+}
@@ -13,6 +13,10 @@
 #include "primitive_function.h"
 #include "function.h"
 #include "macro.h"
+#include "record.h"
+#include "string_buffer.h"
+#include "hamt.h"
+#include "pvector.h"
 #include "environment_frame.h"
 
 
@@ -26,17 +30,32 @@
 #define FUNCTION_TYPE 7
 #define MACRO_TYPE 8
 #define PRIMITIVE_TYPE 9
+#define RECORD_TYPE 10
+#define RECORD_DESCRIPTOR_TYPE 11
+#define STRING_BUILDER_TYPE 12
+#define HASH_MAP_TYPE 13
+#define VECTOR_TYPE 14
 
 
+/* A cell whose count reaches the most refs can hold stays at it for good:
+   it's never freed, rather than wrapping around to a count that frees it
+   while still referenced */
+
+#define MAX_REFS 0xFFF
+
 typedef struct data_t {
   struct {
-    __uint8_t type : 4;
-    __uint8_t refs : 4;
+    __uint16_t type : 4;
+    __uint16_t refs : 12;
+    __uint16_t line : 15;       /* source line a parsed cell came from, or 0 */
+    __uint16_t frozen : 1;      /* shared by forked workers; never counted */
   } meta;
   union {
     __int32_t int_data;
     __uint32_t uint_data;
     char *string_data;
+    string_t *string;
+    string_builder_t *builder;
     bool boolean_data;
     struct {
       struct data_t *car_ptr;
@@ -45,28 +64,46 @@ typedef struct data_t {
     primitive_function_t *prim_func;
     function_t *func;
     macro_t *macro;
+    struct {
+      record_type_t *type;
+      struct data_t **slots;
+    } record;
+    record_type_t *record_type;
+    struct {
+      hamt_node_t *root;
+      int count;
+    } hash_map;
+    pvector_t *vector;
     struct data_t *next;
   } data;
 } data_t;
 
-extern data_t *LISP_FALSE;
-extern data_t *LISP_TRUE;
-
 void initialize_lisp_data_system(void);
 
 data_t *alloc_data(__uint8_t);
 void free_data(data_t*);
 void release(data_t*);
 data_t *retain(data_t*);
+data_t *disown(data_t*);
 bool unreferencedp(data_t*);
+bool reference_counting_exempt(data_t*);
+void freeze_heap(void);
+void return_cell_buffer(void);
 int total_cells(void);
 int cells_allocated(void);
 int cells_remaining(void);
 void dump_node(data_t*, int);
 void dump_active_heap(void);
 int heap_index(data_t*);
+data_t *heap_cell(int);
+bool in_heap(data_t*);
+data_t *free_list_head(void);
 /* void gc(void); */
 
+typedef void (*reference_visitor_t)(data_t *d, void *context);
+void for_each_reference(data_t*, reference_visitor_t, void*);
+void for_each_permanent_cell(reference_visitor_t, void*);
+
 data_t *intern_symbol(char*);
 
 __uint8_t type_of(data_t*);
@@ -80,12 +117,21 @@ data_t *unsigned_integer_with_value(__uint32_t);
 __uint32_t unsigned_integer_value(data_t*);
 
 data_t *string_with_value(char*);
+data_t *string_with_length(char*, int);
+data_t *substring_of(data_t*, int, int);
 char *string_value(data_t*);
+char *string_chars(data_t*);
+int string_length(data_t*);
+
+data_t *string_builder_with_capacity(int);
+string_builder_t *string_builder_value(data_t*);
+void string_builder_append(data_t*, char*, int);
 
 data_t *boolean_with_value(bool);
 bool boolean_value(data_t*);
 
 primitive_function_t *make_primitive_function(char*, int, bool, primitive_function_impl);
+primitive_function_t *make_primitive_function_with_context(char*, int, primitive_function_with_context_impl, void*);
 data_t *prim_with_value(primitive_function_t*);
 primitive_function_t *prim_value(data_t*);
 
@@ -97,6 +143,20 @@ macro_t *make_macro(char*, data_t*, data_t*, environment_frame_t*);
 data_t *macro_with_value(macro_t*);
 macro_t *macro_value(data_t*);
 
+record_type_t *make_record_type(char*, data_t*);
+data_t *record_type_with_value(record_type_t*);
+record_type_t *record_type_value(data_t*);
+data_t *record_with_type(record_type_t*);
+record_type_t *record_type_of(data_t*);
+
+data_t *hash_map_with_root(hamt_node_t*, int);
+hamt_node_t *hash_map_root(data_t*);
+int hash_map_count(data_t*);
+
+data_t *pvector_with_value(pvector_t*);
+pvector_t *pvector_value(data_t*);
+void set_pvector_value(data_t*, pvector_t*);
+
 data_t *car(data_t*);
 data_t *cdr(data_t*);
 void set_car(data_t*, data_t*);
@@ -113,11 +173,15 @@ bool is_equal(data_t*, data_t*);
 bool freep(data_t*);
 bool symbolp(data_t*);
 bool stringp(data_t*);
+bool string_builderp(data_t*);
 bool integerp(data_t*);
 bool unsigned_integerp(data_t*);
 bool listp(data_t*);
 bool functionp(data_t*);
 bool macrop(data_t*);
+bool recordp(data_t*);
+bool hash_mapp(data_t*);
+bool pvectorp(data_t*);
 
 /* void mark_cell(data_t*); */
 
@@ -16,6 +16,8 @@
 #include "header.h"
 #include "hash.h"
 #include "dictionary.h"
+#include "stats.h"
+#include "interp.h"
 
 //! \brief Generate the hash slot number for each string.
 int make_hash(char* c) {
@@ -170,6 +172,7 @@ void dictionary_remove(dictionary_t* dict, char* key) {
       /* if (d->data != NULL) */
       /*   free(d->data); */
       free(d);
+      return;
     }
   }
 }
@@ -185,14 +188,17 @@ void dictionary_remove(dictionary_t* dict, char* key) {
 void* dictionary_get(dictionary_t* dict, char* key) {
   DNODE* d;  
   int h = make_hash(key);
+  current_interp->stats.dictionary_lookups++;
   //! This speed up the process.
   if (dict->hash[h] == NULL)
     return NULL;
   //! ok, we have the hash, so we find the actual key.
   for (d = dict->hash[h]; (d!=NULL) && (make_hash(d->key) == h);
-       d = d->next) 
+       d = d->next) {
+    current_interp->stats.dictionary_chain_steps++;
     if (!strncmp(d->key, key, KEY_LENGTH)) 
       return d->data;
+  }
   return NULL;
 }
 
@@ -220,10 +226,9 @@ DNODE* GetDNODEWithKey(dictionary_t* dict, char* key) {
 
 void with_each_value_do(dictionary_t* dict, processing_function_t func)
 {
-  for (int i = 0; i < MAX_HASH_SLOT; i++) {
-    for (DNODE *d = dict->hash[i]; (d != NULL); d = d->next) {
-      func(d->data);
-    }
+  //! Every node is on the start/end list exactly once; the hash slots
+  //! only point into it, so walking from a slot would revisit later nodes.
+  for (DNODE *d = dict->start; (d != NULL); d = d->next) {
+    func(d->data);
   }
- 
 }
@@ -0,0 +1,200 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the API for embedding the interpreter in host code. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "embed.h"
+#include "parser.h"
+#include "evaluator.h"
+
+/* Each entry point runs in the caller's context and then puts back
+   whatever interpreter the thread was running before, so host code that
+   also uses enter_interp is not disturbed. */
+
+
+ms_context_t *ms_new_context(void)
+{
+  return new_interp();
+}
+
+
+void ms_free_context(ms_context_t *context)
+{
+  free_interp(context);
+}
+
+
+/* Evaluates every expression in the source, typically the definitions the
+   host will call later */
+
+bool ms_load(ms_context_t *context, char *source, char **err_ptr)
+{
+  interp_t *previous = enter_interp(context);
+  data_t *result = parse_and_eval_all(source, err_ptr);
+  if (unreferencedp(result)) {
+    release(result);
+  }
+  enter_interp(previous);
+  return *err_ptr == NULL;
+}
+
+
+ms_value_t *ms_lookup(ms_context_t *context, char *name, char **err_ptr)
+{
+  *err_ptr = NULL;
+  interp_t *previous = enter_interp(context);
+  /* Look the name up directly so an unknown name doesn't get interned with
+     the host's storage */
+  binding_t *binding = dictionary_get(GLOBAL_ENV->bindings, name);
+  data_t *value = NULL;
+  if (binding == NULL) {
+    char *buf = (char*)malloc((32 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s is not defined.", name);
+    *err_ptr = buf;
+  } else {
+    value = retain(binding->val);
+  }
+  enter_interp(previous);
+  return value;
+}
+
+
+/* Applies a function or primitive to the arguments, as apply would */
+
+ms_value_t *ms_call(ms_context_t *context, ms_value_t *function, int argc, ms_value_t **argv, char **err_ptr)
+{
+  interp_t *previous = enter_interp(context);
+  data_t *arguments = NULL;
+  for (int i = argc - 1; i >= 0; i--) {
+    arguments = cons(argv[i], arguments);
+  }
+  retain(arguments);
+  environment_frame_t *frame = NULL;
+  data_t *result = retain(apply_to_values(function, arguments, GLOBAL_ENV, &frame, err_ptr));
+  release_call_frame(frame);
+  release(arguments);
+  enter_interp(previous);
+  return result;
+}
+
+
+void ms_release(ms_context_t *context, ms_value_t *value)
+{
+  if (value == NULL) {
+    return;
+  }
+  interp_t *previous = enter_interp(context);
+  release(value);
+  enter_interp(previous);
+}
+
+
+/* Exposes a C function to the context's Scheme code; see foreign.h for
+   the signatures */
+
+bool ms_register(ms_context_t *context, char *name, char *signature, foreign_function_impl function)
+{
+  interp_t *previous = enter_interp(context);
+  bool registered = register_foreign(name, signature, function);
+  enter_interp(previous);
+  return registered;
+}
+
+
+/********************************************************************************/
+/* constructors                                                                 */
+/********************************************************************************/
+
+ms_value_t *ms_int(ms_context_t *context, int value)
+{
+  interp_t *previous = enter_interp(context);
+  data_t *result = retain(integer_with_value(value));
+  enter_interp(previous);
+  return result;
+}
+
+
+/* The characters are copied, so the host keeps ownership of its string */
+
+ms_value_t *ms_string(ms_context_t *context, char *value)
+{
+  interp_t *previous = enter_interp(context);
+  data_t *result = retain(string_with_value(strdup(value)));
+  enter_interp(previous);
+  return result;
+}
+
+
+ms_value_t *ms_list(ms_context_t *context, int count, ms_value_t **items)
+{
+  interp_t *previous = enter_interp(context);
+  data_t *result = NULL;
+  for (int i = count - 1; i >= 0; i--) {
+    result = cons(items[i], result);
+  }
+  retain(result);
+  enter_interp(previous);
+  return result;
+}
+
+
+/********************************************************************************/
+/* accessors                                                                    */
+/********************************************************************************/
+
+bool ms_is_int(ms_value_t *value)
+{
+  return value != NULL && integerp(value);
+}
+
+
+bool ms_is_string(ms_value_t *value)
+{
+  return value != NULL && stringp(value);
+}
+
+
+bool ms_is_list(ms_value_t *value)
+{
+  return listp(value);
+}
+
+
+int ms_int_value(ms_value_t *value)
+{
+  return integer_value(value);
+}
+
+
+/* Valid for as long as the host holds the value */
+
+char *ms_string_value(ms_value_t *value)
+{
+  return string_value(value);
+}
+
+
+int ms_list_length(ms_value_t *value)
+{
+  return length_of(value);
+}
+
+
+ms_value_t *ms_list_ref(ms_context_t *context, ms_value_t *list, int index)
+{
+  for (int i = 0; list != NULL && i < index; i++) {
+    list = cdr(list);
+  }
+  if (list == NULL) {
+    return NULL;
+  }
+  interp_t *previous = enter_interp(context);
+  data_t *result = retain(car(list));
+  enter_interp(previous);
+  return result;
+}
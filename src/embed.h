@@ -0,0 +1,49 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the API for embedding the interpreter in host code. */
+
+#ifndef __EMBED_H
+#define __EMBED_H
+
+#include <stdbool.h>
+#include "interp.h"
+#include "foreign.h"
+
+/* A host loads its Scheme source once, looks up the functions it wants by
+   name once, then calls them as often as it likes without re-parsing.
+
+   Every value this API hands back (from a constructor, ms_lookup, ms_call
+   or an accessor) carries a reference that keeps it alive, across any
+   number of later calls, until the host passes it to ms_release.  Values
+   the host passes in are only borrowed.  The empty list is NULL.
+
+   Errors come back through err_ptr as a message the host must free.  A
+   context must only be used by one thread at a time. */
+
+typedef interp_t ms_context_t;
+typedef data_t ms_value_t;
+
+ms_context_t *ms_new_context(void);
+void ms_free_context(ms_context_t *context);
+bool ms_load(ms_context_t *context, char *source, char **err_ptr);
+ms_value_t *ms_lookup(ms_context_t *context, char *name, char **err_ptr);
+ms_value_t *ms_call(ms_context_t *context, ms_value_t *function, int argc, ms_value_t **argv, char **err_ptr);
+void ms_release(ms_context_t *context, ms_value_t *value);
+bool ms_register(ms_context_t *context, char *name, char *signature, foreign_function_impl function);
+
+ms_value_t *ms_int(ms_context_t *context, int value);
+ms_value_t *ms_string(ms_context_t *context, char *value);
+ms_value_t *ms_list(ms_context_t *context, int count, ms_value_t **items);
+
+bool ms_is_int(ms_value_t *value);
+bool ms_is_string(ms_value_t *value);
+bool ms_is_list(ms_value_t *value);
+int ms_int_value(ms_value_t *value);
+char *ms_string_value(ms_value_t *value);
+int ms_list_length(ms_value_t *value);
+ms_value_t *ms_list_ref(ms_context_t *context, ms_value_t *list, int index);
+
+#endif
@@ -10,9 +10,9 @@
 #include <stdio.h>
 #include "environment_frame.h"
 #include "logging.h"
-
-
-environment_frame_t *GLOBAL_ENV;
+#include "stats.h"
+#include "tracer.h"
+#include "interp.h"
 
 void init_environments(void);
 void add_environment(environment_frame_t *value);
@@ -61,6 +61,10 @@ environment_frame_t *new_environment_frame_below(environment_frame_t *parent_fra
 {
   environment_frame_t *e = (environment_frame_t*)malloc(sizeof(environment_frame_t));
   log_debug("Environment 0x%lX created.", (uintptr_t)e);
+  current_interp->stats.frames_created++;
+  if (tracing) {
+    trace_instant("frame", "frame");
+  }
 
   e->parent = parent_frame;
   e->bindings = new_dictionary();
@@ -74,7 +78,7 @@ environment_frame_t *new_environment_frame_below(environment_frame_t *parent_fra
 }
 
 
-void bind(environment_frame_t *frame, data_t *symbol, data_t *value)
+void bind_symbol(environment_frame_t *frame, data_t *symbol, data_t *value)
 {
   binding_t* binding_or_nil = get_binding(frame, symbol);
   if (binding_or_nil == NULL) {
@@ -173,5 +177,6 @@ void go_out_of_scope(environment_frame_t *env)
     remove_environment(env);
     clean_environment(env);
     free(env);
+    current_interp->stats.frames_freed++;
   }
 }
@@ -23,15 +23,14 @@ typedef struct environment_frame_t {
   dictionary_t *bindings;
 } environment_frame_t;
 
-extern environment_frame_t *GLOBAL_ENV;
-
-
 void initialize_environment(void);
 environment_frame_t *new_environment_frame_below(environment_frame_t*);
-void bind(environment_frame_t *frame, data_t *symbol, data_t *value);
+void bind_symbol(environment_frame_t *frame, data_t *symbol, data_t *value);
 void rebind(environment_frame_t *frame, data_t *symbol, data_t *value);
+binding_t *find_binding(environment_frame_t *frame, data_t *symbol);
 data_t *value_of(environment_frame_t *frame, data_t *symbol);
 /* void mark_cells_in(environment_frame_t *env); */
 void go_out_of_scope(environment_frame_t *env);
+void clean_environment(environment_frame_t *env);
 
 #endif
@@ -3,9 +3,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "environment_vector.h"
+#include "interp.h"
 
+/* The running interpreter's registry of live frames */
 
-EnvVector environments;
+#define environments (current_interp->environments)
 
 void init_environments(void)
 {
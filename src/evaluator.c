@@ -17,11 +17,49 @@
 #include "function.h"
 #include "evaluator.h"
 #include "logging.h"
+#include "stats.h"
+#include "interp.h"
+#include "profiler.h"
+#include "sampler.h"
+#include "tracer.h"
+#include "foreign.h"
+
+
+/* Each application is bracketed for the profiler, the shadow stack and the
+   tracer; each costs a branch when off */
+
+static inline void begin_application(char *name, int kind)
+{
+  if (profiling) {
+    profile_enter(name, kind);
+  }
+  if (kind == PROFILE_FUNCTION) {
+    shadow_push_function(name);
+  } else {
+    shadow_push(name);
+  }
+  if (tracing) {
+    trace_begin(name, profile_kind_name(kind));
+  }
+}
+
+
+static inline void end_application(void)
+{
+  if (tracing) {
+    trace_end();
+  }
+  shadow_pop();
+  if (profiling) {
+    profile_exit();
+  }
+}
 
 
 data_t *apply_func(function_t *func, data_t *arguments, environment_frame_t *env, char **err_ptr)
 {
   *err_ptr = NULL;
+  current_interp->stats.function_applications++;
   int argument_count = length_of(arguments);
   int expected_number_of_arguments = func->number_of_parameters;
   bool any_number_of_arguments = false;
@@ -41,24 +79,28 @@ data_t *apply_func(function_t *func, data_t *arguments, environment_frame_t *env
         go_out_of_scope(local_env);
         return NULL;
       }
-      bind(local_env, car(parameter_cell), argument_value);
+      bind_symbol(local_env, car(parameter_cell), argument_value);
       parameter_cell = cdr(parameter_cell);
       argument_cell = cdr(argument_cell);
     }
 
-    data_t *result = evaluate_each(func->body, local_env, err_ptr);
+    /* The result may only be referenced from the frame's bindings */
+    begin_application(func->name, PROFILE_FUNCTION);
+    data_t *result = retain(evaluate_each(func->body, local_env, err_ptr));
+    end_application();
     go_out_of_scope(local_env);
     if (*err_ptr != NULL) {
       return NULL;
     }
 
-    return result;
+    return disown(result);
   }
 }
 
 
 data_t *expand(macro_t *macro, data_t *arguments, environment_frame_t *env, char **err_ptr)
 {
+  current_interp->stats.macro_expansions++;
   int argument_count = length_of(arguments);
   int expected_number_of_arguments = macro->number_of_parameters;
   bool any_number_of_arguments = false;
@@ -78,20 +120,24 @@ data_t *expand(macro_t *macro, data_t *arguments, environment_frame_t *env, char
         go_out_of_scope(local_env);
         return NULL;
       }
-      release(argument_value); /* It's going straight into a binding which will maintain the reference. The one
-                                       from evaling is excessive*/
-
-      bind(local_env, car(parameter_cell), argument_value);
+      bind_symbol(local_env, car(parameter_cell), argument_value);
       parameter_cell = cdr(parameter_cell);
       argument_cell = cdr(argument_cell);
     }
 
-    data_t *expanded_macro = evaluate(macro->body, local_env, err_ptr);
+    /* The expansion may be a bound argument or part of the macro body */
+    if (tracing) {
+      trace_begin(macro->name, "macro expansion");
+    }
+    data_t *expanded_macro = retain(evaluate(macro->body, local_env, err_ptr));
+    if (tracing) {
+      trace_end();
+    }
     go_out_of_scope(local_env);
     if (*err_ptr != NULL) {
       return NULL;
     }
-    return expanded_macro;
+    return disown(expanded_macro);
   }
 }
 
@@ -99,15 +145,50 @@ data_t *expand(macro_t *macro, data_t *arguments, environment_frame_t *env, char
 data_t *apply_macro(macro_t *macro, data_t *arguments, environment_frame_t *env, char **err_ptr)
 {
   *err_ptr = NULL;
+  current_interp->stats.macro_applications++;
 
-  data_t *expanded_macro = expand(macro, arguments, env, err_ptr);
-  data_t *result = evaluate(expanded_macro, env, err_ptr);
+  begin_application(macro->name, PROFILE_MACRO);
+  data_t *expanded_macro = retain(expand(macro, arguments, env, err_ptr));
+  if (*err_ptr != NULL) {
+    end_application();
+    return NULL;
+  }
+  data_t *result = retain(evaluate(expanded_macro, env, err_ptr));
+  end_application();
   release(expanded_macro);
   if (*err_ptr != NULL) {
     return NULL;
   }
 
-  return result;
+  return disown(result);
+}
+
+
+/* Typed C functions take their evaluated arguments straight from an array,
+   so no argument list is built. */
+
+static data_t *apply_foreign_prim(primitive_function_t *prim, data_t *arguments, environment_frame_t *env, char **err_ptr)
+{
+  data_t *values[FOREIGN_MAX_ARGUMENTS];
+  int count = 0;
+  for (data_t *argument_cell = arguments; argument_cell != NULL; argument_cell = cdr(argument_cell)) {
+    values[count] = retain(evaluate(car(argument_cell), env, err_ptr));
+    if (*err_ptr != NULL) {
+      release(values[count]);
+      break;
+    }
+    count++;
+  }
+  data_t *result = NULL;
+  if (*err_ptr == NULL) {
+    begin_application(prim->name, PROFILE_PRIMITIVE);
+    result = retain(apply_foreign(prim->foreign, values, err_ptr));
+    end_application();
+  }
+  for (int i = 0; i < count; i++) {
+    release(values[i]);
+  }
+  return disown(result);
 }
 
 
@@ -115,6 +196,7 @@ data_t *apply_prim(primitive_function_t *prim, data_t *arguments, environment_fr
 {
   log_debug("Entering %s", prim->name);
   *err_ptr = NULL;
+  current_interp->stats.primitive_applications++;
   int argument_count = length_of(arguments);
   int expected_number_of_arguments = prim->number_of_parameters;
   bool any_number_of_arguments = expected_number_of_arguments == -1;
@@ -124,6 +206,8 @@ data_t *apply_prim(primitive_function_t *prim, data_t *arguments, environment_fr
     sprintf(buf, "Wrong number of arguments to %s. Expected %d but got %d.", prim->name, expected_number_of_arguments, argument_count);
     *err_ptr = buf;
     return NULL;
+  } else if (prim->foreign != NULL) {
+    return apply_foreign_prim(prim, arguments, env, err_ptr);
   } else {
     data_t *argument_values;
     if (prim->special_form) {
@@ -144,30 +228,156 @@ data_t *apply_prim(primitive_function_t *prim, data_t *arguments, environment_fr
       /* } */
       vector_free(&v_arguments);
     }
-    data_t *result = prim->impl(argument_values, env, err_ptr);
+    begin_application(prim->name, prim->special_form ? PROFILE_SPECIAL_FORM : PROFILE_PRIMITIVE);
+    data_t *result = retain(invoke_primitive(prim, argument_values, env, err_ptr));
+    end_application();
 
     if (!prim->special_form) {
       release(argument_values);
     }
+    disown(result);
 
     if (*err_ptr != NULL) {
       return NULL;
     }
-    char* str = to_string(result);
-    log_debug("Prim %s returning %s", prim->name, str);
-    free(str);
+    if (log_enabled(DEBUG)) {
+      char* str = to_string(result);
+      log_debug("Prim %s returning %s", prim->name, str);
+      free(str);
+    }
     return result;
   }
 }
 
 
+/* A frame that gained bindings beyond the parameters (from a define in
+   the body) can't be reused: rebinding the parameters would leave those
+   in place for the next call */
+
+static bool holds_only_parameters(environment_frame_t *frame, int number_of_parameters)
+{
+  int bindings = 0;
+  for (DNODE *node = frame->bindings->start; node != NULL; node = node->next) {
+    if (++bindings > number_of_parameters) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+/* Apply a function or primitive to arguments that have already been
+   evaluated.  The argument frame for a function is handed back through
+   frame_ptr so that callers iterating over a list can reuse it for the next
+   call; it is only abandoned if the body captured it in a closure.  The
+   caller must retain the result before the next call and hand the frame to
+   release_call_frame when done. */
+
+data_t *apply_func_to_values(function_t *func, data_t *argument_values, environment_frame_t **frame_ptr, char **err_ptr)
+{
+  *err_ptr = NULL;
+  current_interp->stats.function_applications++;
+  int argument_count = length_of(argument_values);
+  if (func->number_of_parameters != argument_count) {
+    char *buf = (char*)malloc((64 + strlen(func->name)) * sizeof(char));
+    sprintf(buf, "Wrong number of arguments to %s. Expected %d but got %d.", func->name, func->number_of_parameters, argument_count);
+    *err_ptr = buf;
+    return NULL;
+  }
+
+  environment_frame_t *local_env = *frame_ptr;
+  bool reusing_frame = local_env != NULL;
+  if (!reusing_frame) {
+    local_env = new_environment_frame_below(func->env);
+  }
+  data_t *value_cell = argument_values;
+  data_t *parameter_cell = func->parameters;
+  while (value_cell != NULL) {
+    if (reusing_frame) {
+      rebind(local_env, car(parameter_cell), car(value_cell));
+    } else {
+      bind_symbol(local_env, car(parameter_cell), car(value_cell));
+    }
+    parameter_cell = cdr(parameter_cell);
+    value_cell = cdr(value_cell);
+  }
+
+  begin_application(func->name, PROFILE_FUNCTION);
+  data_t *result = evaluate_each(func->body, local_env, err_ptr);
+  end_application();
+  if (local_env->descendants > 0 || !holds_only_parameters(local_env, func->number_of_parameters)) {
+    go_out_of_scope(local_env);
+    local_env = NULL;
+  }
+  *frame_ptr = local_env;
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  return result;
+}
+
+
+data_t *apply_to_values(data_t *callable, data_t *argument_values, environment_frame_t *env, environment_frame_t **frame_ptr, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (type_of(callable) == FUNCTION_TYPE) {
+    return apply_func_to_values(func_value(callable), argument_values, frame_ptr, err_ptr);
+  } else if (type_of(callable) == PRIMITIVE_TYPE) {
+    primitive_function_t *prim = prim_value(callable);
+    if (prim->special_form) {
+      char *buf = (char*)malloc((64 + strlen(prim->name)) * sizeof(char));
+      sprintf(buf, "Special form %s can not be applied to values.", prim->name);
+      *err_ptr = buf;
+      return NULL;
+    }
+    int argument_count = length_of(argument_values);
+    if (prim->number_of_parameters != -1 && prim->number_of_parameters != argument_count) {
+      char *buf = (char*)malloc((64 + strlen(prim->name)) * sizeof(char));
+      sprintf(buf, "Wrong number of arguments to %s. Expected %d but got %d.", prim->name, prim->number_of_parameters, argument_count);
+      *err_ptr = buf;
+      return NULL;
+    }
+    current_interp->stats.primitive_applications++;
+    begin_application(prim->name, PROFILE_PRIMITIVE);
+    data_t *result = invoke_primitive(prim, argument_values, env, err_ptr);
+    end_application();
+    if (*err_ptr != NULL) {
+      return NULL;
+    }
+    return result;
+  } else {
+    *err_ptr = strdup("Function or primitive expected. Something else found.");
+    return NULL;
+  }
+}
+
+
+void release_call_frame(environment_frame_t *frame)
+{
+  if (frame != NULL) {
+    go_out_of_scope(frame);
+  }
+}
+
+
 data_t *evaluate(data_t *sexpr, environment_frame_t *env, char **err_ptr)
 {
   data_t *result = NULL;
-  char* str = to_string(sexpr);
-  log_debug("Evaluating %s", str);
-  free(str);
+  current_interp->stats.evaluations++;
+  note_stack_depth(&result);
+  if (log_enabled(DEBUG)) {
+    char* str = to_string(sexpr);
+    log_debug("Evaluating %s", str);
+    free(str);
+  }
   *err_ptr = NULL;
+  if (current_interp->step_budget > 0 && --current_interp->steps_left <= 0) {
+    current_interp->steps_left = current_interp->step_budget;
+    if (!current_interp->step_hook()) {
+      *err_ptr = strdup("Evaluation abandoned by the step hook");
+      return NULL;
+    }
+  }
   switch (type_of(sexpr)) {
   case FREE_TYPE:
     result = NULL;
@@ -179,6 +389,11 @@ data_t *evaluate(data_t *sexpr, environment_frame_t *env, char **err_ptr)
   case FUNCTION_TYPE:
   case MACRO_TYPE:
   case PRIMITIVE_TYPE:
+  case RECORD_TYPE:
+  case RECORD_DESCRIPTOR_TYPE:
+  case STRING_BUILDER_TYPE:
+  case HASH_MAP_TYPE:
+  case VECTOR_TYPE:
     result = sexpr;
     break;
   case SYMBOL_TYPE:
@@ -227,9 +442,11 @@ data_t *evaluate(data_t *sexpr, environment_frame_t *env, char **err_ptr)
   if (freep(result)) {
     log_critical("HOLY SHIT! EVALUATE RESULTED IN A FREE NODE!!!");
   }
-  str = to_string(result);
-  log_debug("Evaluate returning %s", str);
-  free(str);
+  if (log_enabled(DEBUG)) {
+    char* str = to_string(result);
+    log_debug("Evaluate returning %s", str);
+    free(str);
+  }
   return result;
 }
 
@@ -239,7 +456,9 @@ data_t *evaluate_each(data_t *sexprs, environment_frame_t *env, char **err_ptr)
   data_t *result = NULL;
   *err_ptr = NULL;
   for (data_t *cell = sexprs; cell != NULL; cell = cdr(cell)) {
-    release(result);
+    if (unreferencedp(result)) {
+      release(result);
+    }
     result = evaluate(car(cell), env, err_ptr);
     if (*err_ptr != NULL) {
       return NULL;
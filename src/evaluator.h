@@ -22,6 +22,10 @@ data_t *apply_prim(primitive_function_t *prim, data_t *args, environment_frame_t
 data_t *expand(macro_t *macro, data_t *arguments, environment_frame_t *env, char **err_ptr);
 data_t *apply_macro(macro_t *macro, data_t *arguments, environment_frame_t *env, char **err_ptr);
 
+data_t *apply_func_to_values(function_t *func, data_t *argument_values, environment_frame_t **frame_ptr, char **err_ptr);
+data_t *apply_to_values(data_t *callable, data_t *argument_values, environment_frame_t *env, environment_frame_t **frame_ptr, char **err_ptr);
+void release_call_frame(environment_frame_t *frame);
+
 data_t *evaluate(data_t *sexpr, environment_frame_t *env, char **err_ptr);
 data_t *evaluate_each(data_t *sexpr, environment_frame_t *env, char **err_ptr);
 #endif
@@ -0,0 +1,233 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains typed registration of C functions as primitives. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "foreign.h"
+#include "environment_frame.h"
+#include "logging.h"
+#include "interp.h"
+
+typedef intptr_t (*foreign_0_t)(void);
+typedef intptr_t (*foreign_1_t)(intptr_t);
+typedef intptr_t (*foreign_2_t)(intptr_t, intptr_t);
+typedef intptr_t (*foreign_3_t)(intptr_t, intptr_t, intptr_t);
+typedef intptr_t (*foreign_4_t)(intptr_t, intptr_t, intptr_t, intptr_t);
+
+
+/********************************************************************************/
+/* signatures                                                                   */
+/********************************************************************************/
+
+static struct {
+  char *name;
+  int type;
+} type_names[] = {
+  {"void", FOREIGN_VOID},
+  {"int", FOREIGN_INT},
+  {"uint32_t", FOREIGN_UINT32},
+  {"bool", FOREIGN_BOOL},
+  {"string", FOREIGN_STRING},
+  {"char*", FOREIGN_STRING},
+};
+
+
+/* Reads the type name at *cursor, skipping spaces, and leaves the cursor
+   after it.  Returns -1 for an unknown type. */
+
+static int parse_type(char **cursor)
+{
+  char *c = *cursor;
+  while (isspace((unsigned char)*c)) {
+    c++;
+  }
+  char *start = c;
+  while (isalnum((unsigned char)*c) || *c == '_' || *c == '*') {
+    c++;
+  }
+  int length = c - start;
+  while (isspace((unsigned char)*c)) {
+    c++;
+  }
+  *cursor = c;
+  for (int i = 0; i < (int)(sizeof(type_names) / sizeof(type_names[0])); i++) {
+    if ((int)strlen(type_names[i].name) == length && strncmp(type_names[i].name, start, length) == 0) {
+      return type_names[i].type;
+    }
+  }
+  return -1;
+}
+
+
+/* Fills in the types from a signature like "int(int,string)" */
+
+static bool parse_signature(char *signature, foreign_function_t *foreign)
+{
+  char *cursor = signature;
+  foreign->result_type = parse_type(&cursor);
+  if (foreign->result_type == -1 || *cursor++ != '(') {
+    return false;
+  }
+  foreign->number_of_arguments = 0;
+  while (isspace((unsigned char)*cursor)) {
+    cursor++;
+  }
+  if (*cursor == ')') {
+    return cursor[1] == '\0';
+  }
+  while (true) {
+    int type = parse_type(&cursor);
+    if (type == -1 || type == FOREIGN_VOID || foreign->number_of_arguments == FOREIGN_MAX_ARGUMENTS) {
+      return false;
+    }
+    foreign->argument_types[foreign->number_of_arguments++] = type;
+    if (*cursor == ')') {
+      return cursor[1] == '\0';
+    } else if (*cursor++ != ',') {
+      return false;
+    }
+  }
+}
+
+
+/********************************************************************************/
+/* calling                                                                      */
+/********************************************************************************/
+
+static char *foreign_type_name(int type)
+{
+  switch (type) {
+  case FOREIGN_INT:
+    return "an integer";
+  case FOREIGN_UINT32:
+    return "an unsigned integer";
+  case FOREIGN_BOOL:
+    return "a boolean";
+  case FOREIGN_STRING:
+    return "a string";
+  default:
+    return "nothing";
+  }
+}
+
+
+static bool unbox(data_t *value, int type, intptr_t *word)
+{
+  switch (type) {
+  case FOREIGN_INT:
+    if (!integerp(value) && !unsigned_integerp(value)) {
+      return false;
+    }
+    *word = (intptr_t)integer_value(value);
+    return true;
+  case FOREIGN_UINT32:
+    if (!integerp(value) && !unsigned_integerp(value)) {
+      return false;
+    }
+    *word = (intptr_t)unsigned_integer_value(value);
+    return true;
+  case FOREIGN_BOOL:
+    *word = (intptr_t)boolean_value(value);
+    return true;
+  case FOREIGN_STRING:
+    if (!stringp(value)) {
+      return false;
+    }
+    *word = (intptr_t)string_value(value);
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+static data_t *box(intptr_t word, int type)
+{
+  switch (type) {
+  case FOREIGN_INT:
+    return integer_with_value((int)word);
+  case FOREIGN_UINT32:
+    return unsigned_integer_with_value((__uint32_t)word);
+  case FOREIGN_BOOL:
+    return boolean_with_value((word & 0xff) != 0);
+  case FOREIGN_STRING:
+    return (word == 0) ? NULL : string_with_value(strdup((char*)word));
+  default:
+    return NULL;
+  }
+}
+
+
+/* Calls the function with values that have already been evaluated and
+   counted; the caller keeps them alive until this returns */
+
+data_t *apply_foreign(foreign_function_t *foreign, data_t **values, char **err_ptr)
+{
+  *err_ptr = NULL;
+  intptr_t words[FOREIGN_MAX_ARGUMENTS];
+  for (int i = 0; i < foreign->number_of_arguments; i++) {
+    if (values[i] == NULL || !unbox(values[i], foreign->argument_types[i], &words[i])) {
+      char *buf = (char*)malloc((64 + strlen(foreign->name)) * sizeof(char));
+      sprintf(buf, "%s expected %s for argument %d.", foreign->name, foreign_type_name(foreign->argument_types[i]), i + 1);
+      *err_ptr = buf;
+      return NULL;
+    }
+  }
+
+  intptr_t result = 0;
+  switch (foreign->number_of_arguments) {
+  case 0:
+    result = ((foreign_0_t)foreign->function)();
+    break;
+  case 1:
+    result = ((foreign_1_t)foreign->function)(words[0]);
+    break;
+  case 2:
+    result = ((foreign_2_t)foreign->function)(words[0], words[1]);
+    break;
+  case 3:
+    result = ((foreign_3_t)foreign->function)(words[0], words[1], words[2]);
+    break;
+  case 4:
+    result = ((foreign_4_t)foreign->function)(words[0], words[1], words[2], words[3]);
+    break;
+  }
+  return box(result, foreign->result_type);
+}
+
+
+/* The general path, for apply, map and the like, which already have the
+   values in a list */
+
+static data_t *foreign_impl(void *context, data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  data_t *values[FOREIGN_MAX_ARGUMENTS];
+  int count = 0;
+  for (data_t *cell = args; cell != NULL && count < FOREIGN_MAX_ARGUMENTS; cell = cdr(cell)) {
+    values[count++] = car(cell);
+  }
+  return apply_foreign((foreign_function_t*)context, values, err_ptr);
+}
+
+
+bool register_foreign(char *name, char *signature, foreign_function_impl function)
+{
+  foreign_function_t *foreign = (foreign_function_t*)malloc(sizeof(foreign_function_t));
+  foreign->name = name;
+  foreign->function = function;
+  if (!parse_signature(signature, foreign)) {
+    log_error("Bad signature for %s: %s", name, signature);
+    free(foreign);
+    return false;
+  }
+  primitive_function_t *prim = make_primitive_function_with_context(name, foreign->number_of_arguments, &foreign_impl, foreign);
+  prim->foreign = foreign;
+  bind_symbol(GLOBAL_ENV, intern_symbol(name), prim_with_value(prim));
+  return true;
+}
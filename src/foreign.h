@@ -0,0 +1,49 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains typed registration of C functions as primitives. */
+
+#ifndef __FOREIGN_H
+#define __FOREIGN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "data.h"
+
+#define FOREIGN_VOID 0
+#define FOREIGN_INT 1
+#define FOREIGN_UINT32 2
+#define FOREIGN_BOOL 3
+#define FOREIGN_STRING 4
+
+#define FOREIGN_MAX_ARGUMENTS 4
+
+/* Every argument and result is passed in a machine word, which is how
+   both the host and the Cortex M4 pass ints, bools and pointers. */
+
+typedef void (*foreign_function_impl)(void);
+
+typedef struct foreign_function_t {
+  char *name;
+  foreign_function_impl function;
+  int result_type;
+  int number_of_arguments;
+  int argument_types[FOREIGN_MAX_ARGUMENTS];
+} foreign_function_t;
+
+/* Makes a C function callable as a primitive, e.g.
+     REGISTER_FOREIGN("gpio-read", "bool(int)", gpio_read);
+   The signature's types are int, uint32_t, bool, string (char*) and, for
+   results only, void.  Arguments are checked and unboxed from the table,
+   without building an argument list. */
+
+bool register_foreign(char *name, char *signature, foreign_function_impl function);
+
+#define REGISTER_FOREIGN(name, signature, function) \
+  register_foreign((name), (signature), (foreign_function_impl)(function))
+
+data_t *apply_foreign(foreign_function_t *foreign, data_t **values, char **err_ptr);
+
+#endif
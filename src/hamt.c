@@ -0,0 +1,402 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the persistent hash map (hash array mapped trie). */
+
+/* Each level consumes 5 bits of the key's hash to pick one of 32 slots, so
+   lookups and updates touch O(log32 n) nodes. Updates copy only the path
+   from the root to the changed slot; everything else is shared with the
+   original map. Keys whose hashes are identical end up together in a
+   collision node that is searched linearly. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "data.h"
+#include "hamt.h"
+
+#define HAMT_BITS 5
+#define HAMT_MASK 0x1f
+#define HAMT_MAX_SHIFT 30
+
+
+/* Maps hash by combining their entries with addition, so two equal maps
+   hash alike whatever order their entries were added in */
+
+static void add_entry_hash(data_t *key, data_t *value, void *context)
+{
+  __uint32_t *hash = (__uint32_t*)context;
+  *hash += (hash_of(key) * 31 + hash_of(value)) * 2654435761u;
+}
+
+
+/* Keys that compare equal (with eq?) must hash alike, so structured values
+   hash by their contents */
+
+__uint32_t hash_of(data_t *d)
+{
+  __uint32_t hash = 5381;
+  switch (type_of(d)) {
+  case INTEGER_TYPE:
+  case UNSIGNED_INTEGER_TYPE:
+    hash = d->data.uint_data * 2654435761u;
+    break;
+  case STRING_TYPE:
+    {
+      char *chars = string_chars(d);
+      for (int i = 0; i < string_length(d); i++) {
+        hash = ((hash << 5) + hash) + chars[i];
+      }
+    }
+    break;
+  case SYMBOL_TYPE:
+    for (char *c = string_value(d); *c; c++) {
+      hash = ((hash << 5) + hash) + *c;
+    }
+    hash ^= 0x9e3779b9;
+    break;
+  case CONS_CELL_TYPE:
+    for (data_t *cell = d; cell != NULL; cell = cdr(cell)) {
+      hash = (hash * 31) + hash_of(car(cell));
+    }
+    break;
+  case VECTOR_TYPE:
+    {
+      pvector_t *v = pvector_value(d);
+      for (int i = 0; i < v->count; i++) {
+        hash = (hash * 31) + hash_of(pvector_ref(v, i));
+      }
+    }
+    break;
+  case HASH_MAP_TYPE:
+    hamt_for_each(hash_map_root(d), &add_entry_hash, &hash);
+    break;
+  default:
+    hash = (__uint32_t)((unsigned long)d >> 3) * 2654435761u;
+    break;
+  }
+  return hash;
+}
+
+
+hamt_node_t *new_hamt_node(int count)
+{
+  hamt_node_t *node = (hamt_node_t*)malloc(sizeof(hamt_node_t) + count * sizeof(hamt_entry_t));
+  node->refs = 1;
+  node->collision = false;
+  node->bitmap = 0;
+  node->count = count;
+  return node;
+}
+
+
+void retain_entry(hamt_entry_t *entry)
+{
+  if (!entry->is_node) {
+    retain(entry->key);
+    retain(entry->value);
+  } else {
+    entry->node->refs++;
+  }
+}
+
+
+void release_entry(hamt_entry_t *entry)
+{
+  if (!entry->is_node) {
+    release(entry->key);
+    release(entry->value);
+  } else {
+    hamt_release(entry->node);
+  }
+}
+
+
+void hamt_release(hamt_node_t *node)
+{
+  if (node == NULL || --node->refs > 0) {
+    return;
+  }
+  for (int i = 0; i < node->count; i++) {
+    release_entry(&node->entries[i]);
+  }
+  free(node);
+}
+
+
+hamt_node_t *share(hamt_node_t *node)
+{
+  node->refs++;
+  return node;
+}
+
+
+int slot_index(hamt_node_t *node, __uint32_t bit)
+{
+  return __builtin_popcount(node->bitmap & (bit - 1));
+}
+
+
+__uint32_t bit_for(__uint32_t hash, int shift)
+{
+  return 1u << ((hash >> shift) & HAMT_MASK);
+}
+
+
+/* Copies of nodes take their own references to everything they hold, the
+   entry being replaced, inserted, or removed is left to the caller. */
+
+hamt_node_t *copy_replacing(hamt_node_t *node, int index, hamt_entry_t entry)
+{
+  hamt_node_t *copy = new_hamt_node(node->count);
+  copy->collision = node->collision;
+  copy->bitmap = node->bitmap;
+  for (int i = 0; i < node->count; i++) {
+    if (i == index) {
+      copy->entries[i] = entry;
+    } else {
+      copy->entries[i] = node->entries[i];
+      retain_entry(&copy->entries[i]);
+    }
+  }
+  return copy;
+}
+
+
+hamt_node_t *copy_inserting(hamt_node_t *node, int index, __uint32_t bit, hamt_entry_t entry)
+{
+  hamt_node_t *copy = new_hamt_node(node->count + 1);
+  copy->collision = node->collision;
+  copy->bitmap = node->bitmap | bit;
+  for (int i = 0, j = 0; i < copy->count; i++) {
+    if (i == index) {
+      copy->entries[i] = entry;
+    } else {
+      copy->entries[i] = node->entries[j++];
+      retain_entry(&copy->entries[i]);
+    }
+  }
+  return copy;
+}
+
+
+hamt_node_t *copy_removing(hamt_node_t *node, int index, __uint32_t bit)
+{
+  if (node->count == 1) {
+    return NULL;
+  }
+  hamt_node_t *copy = new_hamt_node(node->count - 1);
+  copy->collision = node->collision;
+  copy->bitmap = node->bitmap & ~bit;
+  for (int i = 0, j = 0; i < node->count; i++) {
+    if (i != index) {
+      copy->entries[j] = node->entries[i];
+      retain_entry(&copy->entries[j++]);
+    }
+  }
+  return copy;
+}
+
+
+hamt_entry_t leaf_entry(data_t *key, data_t *value)
+{
+  hamt_entry_t entry;
+  entry.is_node = false;
+  entry.key = retain(key);
+  entry.value = retain(value);
+  return entry;
+}
+
+
+hamt_entry_t node_entry(hamt_node_t *node)
+{
+  hamt_entry_t entry;
+  entry.is_node = true;
+  entry.key = NULL;
+  entry.node = node;
+  return entry;
+}
+
+
+/* Builds the smallest subtree that separates two leaves whose hashes agree
+   on every bit consumed so far. */
+
+hamt_node_t *merge_leaves(int shift, __uint32_t hash1, hamt_entry_t entry1, __uint32_t hash2, hamt_entry_t entry2)
+{
+  if (shift > HAMT_MAX_SHIFT) {
+    hamt_node_t *node = new_hamt_node(2);
+    node->collision = true;
+    node->entries[0] = entry1;
+    node->entries[1] = entry2;
+    return node;
+  }
+  __uint32_t bit1 = bit_for(hash1, shift);
+  __uint32_t bit2 = bit_for(hash2, shift);
+  if (bit1 == bit2) {
+    hamt_node_t *node = new_hamt_node(1);
+    node->bitmap = bit1;
+    node->entries[0] = node_entry(merge_leaves(shift + HAMT_BITS, hash1, entry1, hash2, entry2));
+    return node;
+  }
+  hamt_node_t *node = new_hamt_node(2);
+  node->bitmap = bit1 | bit2;
+  node->entries[(bit1 < bit2) ? 0 : 1] = entry1;
+  node->entries[(bit1 < bit2) ? 1 : 0] = entry2;
+  return node;
+}
+
+
+data_t *hamt_get(hamt_node_t *node, data_t *key, bool *found)
+{
+  __uint32_t hash = hash_of(key);
+  int shift = 0;
+  *found = false;
+  while (node != NULL) {
+    if (node->collision) {
+      for (int i = 0; i < node->count; i++) {
+        if (is_equal(node->entries[i].key, key)) {
+          *found = true;
+          return node->entries[i].value;
+        }
+      }
+      return NULL;
+    }
+    __uint32_t bit = bit_for(hash, shift);
+    if ((node->bitmap & bit) == 0) {
+      return NULL;
+    }
+    hamt_entry_t *entry = &node->entries[slot_index(node, bit)];
+    if (entry->is_node) {
+      node = entry->node;
+      shift += HAMT_BITS;
+    } else if (is_equal(entry->key, key)) {
+      *found = true;
+      return entry->value;
+    } else {
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+
+hamt_node_t *assoc_in(hamt_node_t *node, int shift, __uint32_t hash, data_t *key, data_t *value, bool *added)
+{
+  if (node == NULL) {
+    node = new_hamt_node(1);
+    node->bitmap = bit_for(hash, shift);
+    node->entries[0] = leaf_entry(key, value);
+    *added = true;
+    return node;
+  }
+
+  if (node->collision) {
+    for (int i = 0; i < node->count; i++) {
+      if (is_equal(node->entries[i].key, key)) {
+        return copy_replacing(node, i, leaf_entry(key, value));
+      }
+    }
+    *added = true;
+    return copy_inserting(node, node->count, 0, leaf_entry(key, value));
+  }
+
+  __uint32_t bit = bit_for(hash, shift);
+  int index = slot_index(node, bit);
+  if ((node->bitmap & bit) == 0) {
+    *added = true;
+    return copy_inserting(node, index, bit, leaf_entry(key, value));
+  }
+
+  hamt_entry_t *entry = &node->entries[index];
+  if (entry->is_node) {
+    hamt_node_t *child = assoc_in(entry->node, shift + HAMT_BITS, hash, key, value, added);
+    return copy_replacing(node, index, node_entry(child));
+  } else if (is_equal(entry->key, key)) {
+    if (entry->value == value) {
+      return share(node);
+    }
+    return copy_replacing(node, index, leaf_entry(key, value));
+  } else {
+    hamt_entry_t existing = leaf_entry(entry->key, entry->value);
+    hamt_node_t *child = merge_leaves(shift + HAMT_BITS, hash_of(entry->key), existing, hash, leaf_entry(key, value));
+    *added = true;
+    return copy_replacing(node, index, node_entry(child));
+  }
+}
+
+
+hamt_node_t *dissoc_in(hamt_node_t *node, int shift, __uint32_t hash, data_t *key, bool *removed)
+{
+  if (node->collision) {
+    for (int i = 0; i < node->count; i++) {
+      if (is_equal(node->entries[i].key, key)) {
+        *removed = true;
+        return copy_removing(node, i, 0);
+      }
+    }
+    return share(node);
+  }
+
+  __uint32_t bit = bit_for(hash, shift);
+  if ((node->bitmap & bit) == 0) {
+    return share(node);
+  }
+  int index = slot_index(node, bit);
+  hamt_entry_t *entry = &node->entries[index];
+  if (!entry->is_node) {
+    if (!is_equal(entry->key, key)) {
+      return share(node);
+    }
+    *removed = true;
+    return copy_removing(node, index, bit);
+  }
+
+  hamt_node_t *child = dissoc_in(entry->node, shift + HAMT_BITS, hash, key, removed);
+  if (child == entry->node) {
+    hamt_release(child);
+    return share(node);
+  }
+  if (child == NULL) {
+    return copy_removing(node, index, bit);
+  }
+  if (child->count == 1 && !child->entries[0].is_node) {
+    /* Pull a lone leaf up rather than keep a chain of single entry nodes */
+    hamt_entry_t lone = leaf_entry(child->entries[0].key, child->entries[0].value);
+    hamt_release(child);
+    return copy_replacing(node, index, lone);
+  }
+  return copy_replacing(node, index, node_entry(child));
+}
+
+
+hamt_node_t *hamt_assoc(hamt_node_t *root, data_t *key, data_t *value, bool *added)
+{
+  *added = false;
+  return assoc_in(root, 0, hash_of(key), key, value, added);
+}
+
+
+hamt_node_t *hamt_dissoc(hamt_node_t *root, data_t *key, bool *removed)
+{
+  *removed = false;
+  if (root == NULL) {
+    return NULL;
+  }
+  return dissoc_in(root, 0, hash_of(key), key, removed);
+}
+
+
+void hamt_for_each(hamt_node_t *node, hamt_visitor_t visitor, void *context)
+{
+  if (node == NULL) {
+    return;
+  }
+  for (int i = 0; i < node->count; i++) {
+    if (!node->entries[i].is_node) {
+      visitor(node->entries[i].key, node->entries[i].value, context);
+    } else {
+      hamt_for_each(node->entries[i].node, visitor, context);
+    }
+  }
+}
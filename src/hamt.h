@@ -0,0 +1,47 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the persistent hash map (hash array mapped trie). */
+
+#ifndef __HAMT_H
+#define __HAMT_H
+
+#include <stdbool.h>
+
+typedef struct data_t data_t;
+
+/* A slot holds either a key/value pair or, when is_node is set, a sub
+   node; nil is a legal key, so the key can't mark which.  Nodes are
+   immutable once built and shared between maps, so they are reference
+   counted independently of the cells that hold them. */
+
+typedef struct hamt_entry_t {
+  bool is_node;
+  data_t *key;
+  union {
+    data_t *value;
+    struct hamt_node_t *node;
+  };
+} hamt_entry_t;
+
+typedef struct hamt_node_t {
+  int refs;
+  bool collision;
+  __uint32_t bitmap;
+  int count;
+  hamt_entry_t entries[];
+} hamt_node_t;
+
+typedef void (*hamt_visitor_t)(data_t *key, data_t *value, void *context);
+
+__uint32_t hash_of(data_t *d);
+
+data_t *hamt_get(hamt_node_t *root, data_t *key, bool *found);
+hamt_node_t *hamt_assoc(hamt_node_t *root, data_t *key, data_t *value, bool *added);
+hamt_node_t *hamt_dissoc(hamt_node_t *root, data_t *key, bool *removed);
+void hamt_for_each(hamt_node_t *root, hamt_visitor_t visitor, void *context);
+void hamt_release(hamt_node_t *node);
+
+#endif
@@ -0,0 +1,239 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the heap integrity checker. */
+
+/* The free list must be acyclic, hold only free cells, and be as long as
+   free_cell_count says, with no free cell missing from it.  No cell or
+   binding may refer to a free cell.  A cell's reference count must be at
+   least the number of references to it, or releasing one of them frees it
+   while others remain.  A higher count is not an error: the evaluator holds
+   references of its own while it works. */
+
+/* Cells inside hash maps and vectors are retained once by each tree node
+   that holds them, and nodes are shared between maps, so references through
+   them can not be counted per cell; such cells only need a count above 0.
+   References from floating cells (a count of 0) are not counted either:
+   scratch lists like the argument cells map reuses borrow their elements
+   without retaining them. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "heap_check.h"
+#include "data.h"
+#include "environment_frame.h"
+#include "environment_vector.h"
+#include "logging.h"
+
+#define MAX_REPORTED_PROBLEMS 20
+
+/* How references from the cell being scanned are treated */
+#define COUNTED 0
+#define HELD_BY_STRUCTURE 1
+#define BORROWED 2
+
+int heap_check_interval = 0;
+static int allocations_since_check = 0;
+static int suspensions = 0;
+
+typedef struct heap_check_t {
+  FILE *out;
+  int problems;
+  int *incoming;
+  bool *held_by_structure;
+  data_t *source;
+  int reference_kind;
+} heap_check_t;
+
+
+static void problem(heap_check_t *check, char *description, data_t *d)
+{
+  check->problems++;
+  if (check->out == NULL || check->problems > MAX_REPORTED_PROBLEMS) {
+    return;
+  }
+  fprintf(check->out, "Heap check: %s", description);
+  if (d != NULL) {
+    fprintf(check->out, " (node %d", heap_index(d));
+    if (check->source != NULL) {
+      fprintf(check->out, ", referred to from %s node %d", type_name(type_of(check->source)), heap_index(check->source));
+    }
+    fprintf(check->out, ")");
+  }
+  fprintf(check->out, "\n");
+}
+
+
+static void check_free_list(heap_check_t *check)
+{
+  char description[96];
+  int length = 0;
+  check->source = NULL;
+  for (data_t *d = free_list_head(); d != NULL; d = d->data.next) {
+    if (!in_heap(d)) {
+      problem(check, "free list runs outside the heap", NULL);
+      return;
+    }
+    if (++length > total_cells()) {
+      problem(check, "free list has a cycle", d);
+      return;
+    }
+    if (type_of(d) != FREE_TYPE) {
+      problem(check, "free list holds a cell that is not free", d);
+    }
+  }
+  if (length != cells_remaining()) {
+    sprintf(description, "free list has %d cells but the free count is %d", length, cells_remaining());
+    problem(check, description, NULL);
+  }
+  int free_cells = 0;
+  for (int i = 0; i < total_cells(); i++) {
+    free_cells += freep(heap_cell(i));
+  }
+  if (free_cells != length) {
+    sprintf(description, "%d cells are free but %d are on the free list", free_cells, length);
+    problem(check, description, NULL);
+  }
+}
+
+
+static void note_reference(data_t *d, void *context)
+{
+  heap_check_t *check = (heap_check_t*)context;
+  if (d == NULL) {
+    return;
+  }
+  if (!in_heap(d)) {
+    problem(check, "reference to a cell outside the heap", NULL);
+    return;
+  }
+  if (freep(d)) {
+    problem(check, "reference to a free cell", d);
+    return;
+  }
+  if (check->reference_kind == COUNTED) {
+    check->incoming[heap_index(d)]++;
+  } else if (check->reference_kind == HELD_BY_STRUCTURE) {
+    check->held_by_structure[heap_index(d)] = true;
+  }
+}
+
+
+static void note_cell_references(heap_check_t *check)
+{
+  for (int i = 0; i < total_cells(); i++) {
+    data_t *d = heap_cell(i);
+    if (!freep(d)) {
+      check->source = d;
+      if (type_of(d) == HASH_MAP_TYPE || type_of(d) == VECTOR_TYPE) {
+        check->reference_kind = HELD_BY_STRUCTURE;
+      } else if (d->meta.refs == 0) {
+        check->reference_kind = BORROWED;
+      } else {
+        check->reference_kind = COUNTED;
+      }
+      for_each_reference(d, &note_reference, check);
+    }
+  }
+}
+
+
+static void note_binding_references(heap_check_t *check)
+{
+  check->source = NULL;
+  check->reference_kind = COUNTED;
+  EnvVector *frames = get_environments();
+  for (int i = 0; i < frames->size; i++) {
+    environment_frame_t *frame = frames->data[i];
+    if (frame != NULL) {
+      for (DNODE *node = frame->bindings->start; node != NULL; node = node->next) {
+        note_reference(((binding_t*)node->data)->val, check);
+      }
+    }
+  }
+}
+
+
+static void check_reference_counts(heap_check_t *check)
+{
+  check->source = NULL;
+  for (int i = 0; i < total_cells(); i++) {
+    data_t *d = heap_cell(i);
+    if (freep(d) || reference_counting_exempt(d)) {
+      continue;
+    }
+    int incoming = check->incoming[i];
+    if (incoming > MAX_REFS) {
+      incoming = MAX_REFS;
+    }
+    if (d->meta.refs < incoming) {
+      char description[96];
+      sprintf(description, "%s has %d references counted but %d found", type_name(type_of(d)), d->meta.refs, incoming);
+      problem(check, description, d);
+    } else if (d->meta.refs == 0 && check->held_by_structure[i]) {
+      char description[96];
+      sprintf(description, "%s in a map or vector has no references counted", type_name(type_of(d)));
+      problem(check, description, d);
+    }
+  }
+}
+
+
+/* Returns the number of problems found, describing them on out if it is
+   not NULL */
+
+int check_heap(FILE *out)
+{
+  heap_check_t check;
+  check.out = out;
+  check.problems = 0;
+  check.source = NULL;
+  check.incoming = (int*)calloc(total_cells(), sizeof(int));
+  check.held_by_structure = (bool*)calloc(total_cells(), sizeof(bool));
+
+  /* So every free cell is on the free list */
+  return_cell_buffer();
+  check_free_list(&check);
+  if (check.problems == 0) {
+    note_cell_references(&check);
+    note_binding_references(&check);
+    check_reference_counts(&check);
+  }
+  if (out != NULL && check.problems > MAX_REPORTED_PROBLEMS) {
+    fprintf(out, "Heap check: %d more problems not shown\n", check.problems - MAX_REPORTED_PROBLEMS);
+  }
+
+  free(check.incoming);
+  free(check.held_by_structure);
+  return check.problems;
+}
+
+
+/* Called from alloc_data, so corruption is caught near the allocation that
+   follows it rather than long after */
+
+void periodic_heap_check(void)
+{
+  if (++allocations_since_check < heap_check_interval || suspensions > 0) {
+    return;
+  }
+  allocations_since_check = 0;
+  if (check_heap(stderr) > 0) {
+    log_critical("Heap check failed");
+    abort();
+  }
+}
+
+
+void suspend_heap_checks(void)
+{
+  suspensions++;
+}
+
+
+void resume_heap_checks(void)
+{
+  suspensions--;
+}
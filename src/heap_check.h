@@ -0,0 +1,27 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the heap integrity checker. */
+
+#ifndef __HEAP_CHECK_H
+#define __HEAP_CHECK_H
+
+#include <stdio.h>
+
+/* In DEBUG_TRACE builds alloc_data checks the heap every this many
+   allocations when it is above 0, and aborts on the first bad check. */
+
+extern int heap_check_interval;
+
+int check_heap(FILE *out);
+void periodic_heap_check(void);
+
+/* Code that knowingly leaves counts out of step while it runs Lisp code,
+   like sort! relinking cells, holds off the periodic checks meanwhile */
+
+void suspend_heap_checks(void);
+void resume_heap_checks(void);
+
+#endif
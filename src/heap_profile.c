@@ -0,0 +1,218 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the allocation site profiler for heap cells. */
+
+/* A site is the Lisp function being applied when a cell was allocated,
+   followed by the primitive or special form inside it that did the
+   allocating, both taken from the shadow stack.  Each cell's site is remembered in
+   a table parallel to the heap so freeing it can lower the live count.
+   Cells allocated before profiling started are not attributed. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "heap_profile.h"
+#include "data.h"
+#include "dictionary.h"
+#include "sampler.h"
+#include "stats.h"
+
+#define TOPLEVEL_SITE "[toplevel]"
+
+typedef struct allocation_site_t {
+  char *name;
+  long total[STATS_CELL_TYPES];
+  long live[STATS_CELL_TYPES];
+} allocation_site_t;
+
+bool heap_profiling = false;
+
+static dictionary_t *site_names = NULL;
+static allocation_site_t **sites = NULL;
+static int number_of_sites = 0;
+static int site_capacity = 0;
+
+/* Site index of each heap cell, or -1 */
+static int *cell_sites = NULL;
+
+static int last_site_index = -1;
+
+
+void heap_profile_start(void)
+{
+  if (heap_profiling) {
+    return;
+  }
+  site_names = new_dictionary();
+  cell_sites = (int*)malloc(total_cells() * sizeof(int));
+  for (int i = 0; i < total_cells(); i++) {
+    cell_sites[i] = -1;
+  }
+  acquire_shadow_stack();
+  heap_profiling = true;
+}
+
+
+void heap_profile_stop(void)
+{
+  if (!heap_profiling) {
+    return;
+  }
+  heap_profiling = false;
+  release_shadow_stack();
+  for (int i = 0; i < number_of_sites; i++) {
+    free(sites[i]->name);
+    free(sites[i]);
+  }
+  free(sites);
+  free(cell_sites);
+  clean_dictionary(site_names);
+  free(site_names);
+  sites = NULL;
+  cell_sites = NULL;
+  site_names = NULL;
+  number_of_sites = 0;
+  site_capacity = 0;
+  last_site_index = -1;
+}
+
+
+/* Sites are kept in an array so a cell can refer to one by index; the
+   dictionary maps names to those indices.  Runs of allocations usually come
+   from the same site, so the last one found is checked first. */
+
+static int site_index_named(char *name)
+{
+  if (last_site_index != -1 && strcmp(sites[last_site_index]->name, name) == 0) {
+    return last_site_index;
+  }
+  int index = (int)(intptr_t)dictionary_get(site_names, name) - 1;
+  if (index == -1) {
+    if (number_of_sites == site_capacity) {
+      site_capacity = (site_capacity == 0) ? 64 : site_capacity * 2;
+      sites = (allocation_site_t**)realloc(sites, site_capacity * sizeof(allocation_site_t*));
+    }
+    allocation_site_t *site = (allocation_site_t*)calloc(1, sizeof(allocation_site_t));
+    site->name = strdup(name);
+    index = number_of_sites++;
+    sites[index] = site;
+    dictionary_put(site_names, site->name, (void*)(intptr_t)(index + 1));
+  }
+  last_site_index = index;
+  return index;
+}
+
+
+static void site_name(char *buffer, int size)
+{
+  char *function = innermost_function_frame();
+  char *frame = innermost_frame();
+  if (function == NULL) {
+    function = TOPLEVEL_SITE;
+  }
+  if (frame == NULL || frame == function) {
+    snprintf(buffer, size, "%s", function);
+  } else {
+    snprintf(buffer, size, "%s (%s)", function, frame);
+  }
+}
+
+
+void heap_profile_allocated(int cell_index, int type)
+{
+  char name[KEY_LENGTH];
+  site_name(name, KEY_LENGTH);
+  int index = site_index_named(name);
+  sites[index]->total[type]++;
+  sites[index]->live[type]++;
+  cell_sites[cell_index] = index;
+}
+
+
+/* Called before the cell's type is overwritten */
+
+void heap_profile_freed(int cell_index, int type)
+{
+  int index = cell_sites[cell_index];
+  if (index != -1) {
+    sites[index]->live[type]--;
+    cell_sites[cell_index] = -1;
+  }
+}
+
+
+char *allocation_site_of(int cell_index)
+{
+  if (!heap_profiling || cell_sites[cell_index] == -1) {
+    return NULL;
+  }
+  return sites[cell_sites[cell_index]]->name;
+}
+
+
+/********************************************************************************/
+/* reporting                                                                    */
+/********************************************************************************/
+
+typedef struct site_row_t {
+  allocation_site_t *site;
+  int type;
+} site_row_t;
+
+
+static int by_live_then_total(const void *a, const void *b)
+{
+  site_row_t *x = (site_row_t*)a;
+  site_row_t *y = (site_row_t*)b;
+  long x_live = x->site->live[x->type], y_live = y->site->live[y->type];
+  if (x_live != y_live) {
+    return (x_live > y_live) ? -1 : 1;
+  }
+  long x_total = x->site->total[x->type], y_total = y->site->total[y->type];
+  if (x_total != y_total) {
+    return (x_total > y_total) ? -1 : 1;
+  }
+  return strcmp(x->site->name, y->site->name);
+}
+
+
+void heap_profile_report(FILE *out)
+{
+  if (!heap_profiling) {
+    fprintf(out, "Heap profiling is off.\n");
+    return;
+  }
+  long live_by_type[STATS_CELL_TYPES] = {0};
+  long total_by_type[STATS_CELL_TYPES] = {0};
+  site_row_t *rows = (site_row_t*)malloc(number_of_sites * STATS_CELL_TYPES * sizeof(site_row_t));
+  int number_of_rows = 0;
+  for (int i = 0; i < number_of_sites; i++) {
+    for (int type = 0; type < STATS_CELL_TYPES; type++) {
+      if (sites[i]->total[type] > 0) {
+        rows[number_of_rows].site = sites[i];
+        rows[number_of_rows].type = type;
+        number_of_rows++;
+        live_by_type[type] += sites[i]->live[type];
+        total_by_type[type] += sites[i]->total[type];
+      }
+    }
+  }
+  qsort(rows, number_of_rows, sizeof(site_row_t), &by_live_then_total);
+
+  fprintf(out, "Heap: %d cells, %d in use, %d free\n", total_cells(), cells_allocated(), cells_remaining());
+  fprintf(out, "%10s %10s  %-5s %s\n", "live", "total", "type", "site");
+  for (int i = 0; i < number_of_rows; i++) {
+    allocation_site_t *site = rows[i].site;
+    fprintf(out, "%10ld %10ld  %-5s %s\n", site->live[rows[i].type], site->total[rows[i].type], type_name(rows[i].type), site->name);
+  }
+  fprintf(out, "%10s %10s  %-5s\n", "live", "total", "type");
+  for (int type = 0; type < STATS_CELL_TYPES; type++) {
+    if (total_by_type[type] > 0) {
+      fprintf(out, "%10ld %10ld  %-5s\n", live_by_type[type], total_by_type[type], type_name(type));
+    }
+  }
+  free(rows);
+}
@@ -0,0 +1,26 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the allocation site profiler for heap cells. */
+
+#ifndef __HEAP_PROFILE_H
+#define __HEAP_PROFILE_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* When on, every cell allocated is attributed to the innermost function,
+   primitive or macro being applied, and counted by type. */
+
+extern bool heap_profiling;
+
+void heap_profile_start(void);
+void heap_profile_stop(void);
+void heap_profile_allocated(int cell_index, int type);
+void heap_profile_freed(int cell_index, int type);
+char *allocation_site_of(int cell_index);
+void heap_profile_report(FILE *out);
+
+#endif
@@ -0,0 +1,223 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the binary heap snapshot writer. */
+
+/* The snapshot is a graph for offline analysis; tools/decode_snapshot.c
+   reads it.  Numbers are unsigned LEB128 varints unless noted.
+
+     header   "ZLHS", version (byte), cell size, total cells,
+              number of type names, then each as a length and its bytes
+     cells    count, then per live cell:
+              index, type (byte), refcount, edge count, edges
+     frames   count, then per environment frame:
+              node id, parent node id + 1 (0 for none), edge count, edges
+     roots    count, node ids
+
+   A cell's node id is its heap index; frame k of the environment registry
+   is node total cells + k.  Edges from a cell are the cells it refers to,
+   plus its frame for functions and macros.  Edges from a frame are the
+   values bound in it.  The roots are the frames still in scope and the
+   cells the data system keeps permanently. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "heap_snapshot.h"
+#include "data.h"
+#include "environment_frame.h"
+#include "environment_vector.h"
+#include "vector.h"
+
+#define SNAPSHOT_BUFFER_SIZE 4096
+
+typedef struct snapshot_writer_t {
+  FILE *out;
+  unsigned char buffer[SNAPSHOT_BUFFER_SIZE];
+  int used;
+  Vector edges;
+} snapshot_writer_t;
+
+
+static void flush_snapshot(snapshot_writer_t *writer)
+{
+  fwrite(writer->buffer, 1, writer->used, writer->out);
+  writer->used = 0;
+}
+
+
+static void write_byte(snapshot_writer_t *writer, unsigned char byte)
+{
+  if (writer->used == SNAPSHOT_BUFFER_SIZE) {
+    flush_snapshot(writer);
+  }
+  writer->buffer[writer->used++] = byte;
+}
+
+
+static void write_varint(snapshot_writer_t *writer, uint32_t value)
+{
+  while (value >= 0x80) {
+    write_byte(writer, (value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  write_byte(writer, value);
+}
+
+
+static void write_bytes(snapshot_writer_t *writer, char *bytes, int length)
+{
+  write_varint(writer, length);
+  for (int i = 0; i < length; i++) {
+    write_byte(writer, bytes[i]);
+  }
+}
+
+
+static int frame_node_id(environment_frame_t *frame)
+{
+  EnvVector *frames = get_environments();
+  for (int i = 0; i < frames->size; i++) {
+    if (frames->data[i] == frame) {
+      return total_cells() + i;
+    }
+  }
+  return -1;
+}
+
+
+/* Edges are gathered first since their count precedes them */
+
+static void collect_edge(data_t *d, void *context)
+{
+  if (d != NULL) {
+    vector_append(&((snapshot_writer_t*)context)->edges, d);
+  }
+}
+
+
+static void write_edges(snapshot_writer_t *writer, int extra_node)
+{
+  write_varint(writer, writer->edges.size + (extra_node != -1));
+  for (int i = 0; i < writer->edges.size; i++) {
+    write_varint(writer, heap_index(vector_get(&writer->edges, i)));
+  }
+  if (extra_node != -1) {
+    write_varint(writer, extra_node);
+  }
+  writer->edges.size = 0;
+}
+
+
+static void write_header(snapshot_writer_t *writer)
+{
+  for (char *c = HEAP_SNAPSHOT_MAGIC; *c; c++) {
+    write_byte(writer, *c);
+  }
+  write_byte(writer, HEAP_SNAPSHOT_VERSION);
+  write_varint(writer, sizeof(data_t));
+  write_varint(writer, total_cells());
+  write_varint(writer, VECTOR_TYPE + 1);
+  for (int type = 0; type <= VECTOR_TYPE; type++) {
+    write_bytes(writer, type_name(type), strlen(type_name(type)));
+  }
+}
+
+
+static int write_cells(snapshot_writer_t *writer)
+{
+  write_varint(writer, cells_allocated());
+  for (int i = 0; i < total_cells(); i++) {
+    data_t *d = heap_cell(i);
+    if (freep(d)) {
+      continue;
+    }
+    write_varint(writer, i);
+    write_byte(writer, type_of(d));
+    write_varint(writer, d->meta.refs);
+    for_each_reference(d, &collect_edge, writer);
+    int frame = -1;
+    if (type_of(d) == FUNCTION_TYPE) {
+      frame = frame_node_id(func_value(d)->env);
+    } else if (type_of(d) == MACRO_TYPE) {
+      frame = frame_node_id(macro_value(d)->env);
+    }
+    write_edges(writer, frame);
+  }
+  return cells_allocated();
+}
+
+
+static int write_frames(snapshot_writer_t *writer)
+{
+  EnvVector *frames = get_environments();
+  int count = 0;
+  for (int i = 0; i < frames->size; i++) {
+    count += frames->data[i] != NULL;
+  }
+  write_varint(writer, count);
+  for (int i = 0; i < frames->size; i++) {
+    environment_frame_t *frame = frames->data[i];
+    if (frame == NULL) {
+      continue;
+    }
+    write_varint(writer, total_cells() + i);
+    write_varint(writer, (frame->parent == NULL) ? 0 : frame_node_id(frame->parent) + 1);
+    for (DNODE *node = frame->bindings->start; node != NULL; node = node->next) {
+      collect_edge(((binding_t*)node->data)->val, writer);
+    }
+    write_edges(writer, -1);
+  }
+  return count;
+}
+
+
+static void write_roots(snapshot_writer_t *writer)
+{
+  EnvVector *frames = get_environments();
+  for_each_permanent_cell(&collect_edge, writer);
+  int count = writer->edges.size;
+  for (int i = 0; i < frames->size; i++) {
+    count += frames->data[i] != NULL && frames->data[i]->in_scope;
+  }
+  write_varint(writer, count);
+  for (int i = 0; i < writer->edges.size; i++) {
+    write_varint(writer, heap_index(vector_get(&writer->edges, i)));
+  }
+  writer->edges.size = 0;
+  for (int i = 0; i < frames->size; i++) {
+    if (frames->data[i] != NULL && frames->data[i]->in_scope) {
+      write_varint(writer, total_cells() + i);
+    }
+  }
+}
+
+
+int write_heap_snapshot(char *filename, char **err_ptr)
+{
+  snapshot_writer_t *writer = (snapshot_writer_t*)malloc(sizeof(snapshot_writer_t));
+  writer->out = fopen(filename, "wb");
+  if (writer->out == NULL) {
+    char *buf = (char*)malloc((48 + strlen(filename)) * sizeof(char));
+    sprintf(buf, "Could not open %s for the heap snapshot", filename);
+    *err_ptr = buf;
+    free(writer);
+    return -1;
+  }
+  writer->used = 0;
+  vector_init(&writer->edges);
+
+  write_header(writer);
+  int nodes = write_cells(writer);
+  nodes += write_frames(writer);
+  write_roots(writer);
+
+  flush_snapshot(writer);
+  fclose(writer->out);
+  vector_free(&writer->edges);
+  free(writer);
+  return nodes;
+}
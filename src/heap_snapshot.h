@@ -0,0 +1,22 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the binary heap snapshot writer. */
+
+#ifndef __HEAP_SNAPSHOT_H
+#define __HEAP_SNAPSHOT_H
+
+#include <stdbool.h>
+
+#define HEAP_SNAPSHOT_MAGIC "ZLHS"
+#define HEAP_SNAPSHOT_VERSION 1
+
+/* Writes every live cell and environment frame, with the references
+   between them, to filename.  Returns the number of nodes written, or -1
+   with err_ptr set. */
+
+int write_heap_snapshot(char *filename, char **err_ptr);
+
+#endif
@@ -0,0 +1,100 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the interpreter context. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "interp.h"
+#include "special_forms.h"
+#include "primitives.h"
+
+/* Programs that only ever need one interpreter use this one, on whichever
+   thread they like, without creating or entering anything */
+
+static interp_t default_interp = { .source_name = "input" };
+
+THREAD_LOCAL interp_t *current_interp = &default_interp;
+
+
+/* Makes this thread run the interpreter, returning the one it was running
+   so the caller can switch back */
+
+interp_t *enter_interp(interp_t *interp)
+{
+  interp_t *previous = current_interp;
+  if (interp != previous) {
+    return_cell_buffer();
+  }
+  current_interp = interp;
+  return previous;
+}
+
+
+/* Makes the running interpreter call the hook every so many evaluation
+   steps; a budget of 0 turns it off */
+
+void set_step_budget(long steps, step_hook_t hook)
+{
+  current_interp->step_budget = (hook == NULL) ? 0 : steps;
+  current_interp->steps_left = steps;
+  current_interp->step_hook = hook;
+}
+
+
+/* Creates an interpreter with its own heap and global environment, with
+   all the special forms and primitives registered. */
+
+interp_t *new_interp(void)
+{
+  interp_t *interp = (interp_t*)calloc(1, sizeof(interp_t));
+  if (interp == NULL) {
+    return NULL;
+  }
+  interp->source_name = "input";
+  interp_t *previous = enter_interp(interp);
+  initialize_lisp_data_system();
+  initialize_environment();
+  register_special_forms();
+  register_primitives();
+  enter_interp(previous);
+  return interp;
+}
+
+
+/* Releases everything bound in the interpreter's frames, then the frames,
+   symbol table and heap.  Storage held by cells that are still live
+   afterwards (symbol names, primitives) is not reclaimed. */
+
+void free_interp(interp_t *interp)
+{
+  if (interp == NULL || interp == &default_interp) {
+    return;
+  }
+  interp_t *previous = enter_interp(interp);
+  EnvVector *frames = get_environments();
+  for (int i = 0; i < frames->size; i++) {
+    if (env_vector_get(frames, i) != NULL) {
+      clean_environment(env_vector_get(frames, i));
+    }
+  }
+  for (int i = 0; i < frames->size; i++) {
+    environment_frame_t *frame = env_vector_get(frames, i);
+    if (frame == NULL) {
+      continue;
+    }
+    with_each_value_do(frame->bindings, &free);
+    clean_dictionary(frame->bindings);
+    free(frame->bindings);
+    free(frame);
+  }
+  env_vector_free(frames);
+  clean_dictionary(interp->interned_symbols);
+  free(interp->interned_symbols);
+  return_cell_buffer();
+  free(interp->heap);
+  enter_interp(previous == interp ? &default_interp : previous);
+  free(interp);
+}
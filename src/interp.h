@@ -0,0 +1,82 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the interpreter context. */
+
+#ifndef __INTERP_H
+#define __INTERP_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "data.h"
+#include "dictionary.h"
+#include "environment_frame.h"
+#include "environment_vector.h"
+#include "tokenizer.h"
+#include "stats.h"
+#include "logging.h"
+
+#define SMALL_INTEGER_CACHE_SIZE 32
+
+/* Called every so many evaluation steps, so a host that can't afford to
+   block (the board's loop, with a radio and watchdog to service) gets
+   control back during long evaluations.  Returning false abandons the
+   evaluation with an error.  It must not evaluate anything itself. */
+
+typedef bool (*step_hook_t)(void);
+
+/* Everything one interpreter owns: its heap, symbols, environments, reader
+   and counters.  Each thread runs whichever interpreter it last entered, so
+   independent interpreters can run on separate threads, but one interpreter
+   must only be used by one thread at a time.  The profiler, sampler, tracer
+   and heap tools are still process wide and watch a single interpreter. */
+
+typedef struct interp_t {
+  data_t *heap;
+  atomic_flag heap_lock;        /* held while the free list changes hands */
+  data_t *free_list;
+  int total_cell_count;
+  int free_cell_count;
+  data_t *small_integer_cache[SMALL_INTEGER_CACHE_SIZE];
+  data_t *lisp_false;
+  data_t *lisp_true;
+  dictionary_t *interned_symbols;
+  environment_frame_t *global_env;
+  EnvVector environments;
+  tokenizer_state_t tokenizer;
+  char *source_name;
+  runtime_stats_t stats;
+  uintptr_t stack_base;
+  long step_budget;             /* evaluation steps between hook calls, or 0 */
+  long steps_left;
+  step_hook_t step_hook;
+} interp_t;
+
+extern THREAD_LOCAL interp_t *current_interp;
+
+#define GLOBAL_ENV (current_interp->global_env)
+#define LISP_FALSE (current_interp->lisp_false)
+#define LISP_TRUE (current_interp->lisp_true)
+
+/* Records how far, in bytes, the C stack has grown below the outermost
+   evaluate */
+
+static inline void note_stack_depth(void *marker)
+{
+  uintptr_t here = (uintptr_t)marker;
+  if (current_interp->stack_base == 0 || here > current_interp->stack_base) {
+    current_interp->stack_base = here;
+  } else if (current_interp->stack_base - here > current_interp->stats.peak_stack_depth) {
+    current_interp->stats.peak_stack_depth = current_interp->stack_base - here;
+  }
+}
+
+
+interp_t *new_interp(void);
+interp_t *enter_interp(interp_t *interp);
+void free_interp(interp_t *interp);
+void set_step_budget(long steps, step_hook_t hook);
+
+#endif
@@ -0,0 +1,247 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the leak detector. */
+
+/* With reference counting a cell that nothing reachable refers to should
+   already be free; any that are not were retained once too often.  Marking
+   runs from every live environment frame's bindings and the permanent
+   cells.  Leaked cells that no other leaked cell refers to are the heads of
+   the leaked structures, and those are the ones printed as samples.  A
+   leaked cycle has no such cell, so the first of its cells found stands in
+   as its head. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "leak_check.h"
+#include "data.h"
+#include "vector.h"
+#include "environment_frame.h"
+#include "environment_vector.h"
+#include "heap_profile.h"
+#include "stats.h"
+
+#define LEAK_SAMPLES_PER_TYPE 3
+#define LEAK_SAMPLE_LENGTH 60
+
+#define UNMARKED 0
+#define REACHABLE 1
+#define LEAKED_INTERIOR 2
+#define LEAKED_HEAD 3
+
+typedef struct mark_state_t {
+  char *marks;
+  Vector pending;
+  char mark;
+  data_t *head;
+} mark_state_t;
+
+
+static void mark_cell(data_t *d, void *context)
+{
+  mark_state_t *state = (mark_state_t*)context;
+  if (d == NULL || freep(d)) {
+    return;
+  }
+  int index = heap_index(d);
+  if (state->marks[index] == UNMARKED) {
+    state->marks[index] = state->mark;
+    vector_append(&state->pending, d);
+  } else if (state->marks[index] == LEAKED_HEAD && d != state->head) {
+    /* Its own walk already marked what it refers to */
+    state->marks[index] = LEAKED_INTERIOR;
+  }
+}
+
+
+static void mark_pending(mark_state_t *state)
+{
+  while (state->pending.size > 0) {
+    data_t *d = vector_get(&state->pending, state->pending.size - 1);
+    state->pending.size--;
+    for_each_reference(d, &mark_cell, state);
+  }
+}
+
+
+static void mark_binding(void *data, mark_state_t *state)
+{
+  binding_t *binding = (binding_t*)data;
+  mark_cell(binding->sym, state);
+  mark_cell(binding->val, state);
+}
+
+
+static void mark_from_roots(mark_state_t *state)
+{
+  state->mark = REACHABLE;
+  for_each_permanent_cell(&mark_cell, state);
+  EnvVector *frames = get_environments();
+  for (int i = 0; i < frames->size; i++) {
+    environment_frame_t *frame = frames->data[i];
+    if (frame != NULL) {
+      for (DNODE *node = frame->bindings->start; node != NULL; node = node->next) {
+        mark_binding(node->data, state);
+      }
+    }
+  }
+  mark_pending(state);
+}
+
+
+/* Each unmarked cell is taken as a head, and everything reachable from it
+   as interior, including earlier heads it reaches; a walk that comes back
+   round to its own head leaves it as the cycle's head */
+
+static void mark_leaked_interiors(mark_state_t *state)
+{
+  state->mark = LEAKED_INTERIOR;
+  for (int i = 0; i < total_cells(); i++) {
+    data_t *d = heap_cell(i);
+    if (!freep(d) && state->marks[i] == UNMARKED) {
+      state->marks[i] = LEAKED_HEAD;
+      state->head = d;
+      for_each_reference(d, &mark_cell, state);
+      mark_pending(state);
+    }
+  }
+  state->head = NULL;
+}
+
+
+/* Samples are written like to_string would, but stop at the sample length,
+   so a leaked cycle doesn't print forever */
+
+typedef struct sample_t {
+  char text[LEAK_SAMPLE_LENGTH + 1];
+  int length;
+} sample_t;
+
+
+static bool sample_full(sample_t *sample)
+{
+  return sample->length >= LEAK_SAMPLE_LENGTH;
+}
+
+
+static void append_to_sample(sample_t *sample, char *str)
+{
+  for (; *str != '\0' && !sample_full(sample); str++) {
+    sample->text[sample->length++] = *str;
+  }
+  sample->text[sample->length] = '\0';
+  if (*str != '\0') {
+    strcpy(sample->text + LEAK_SAMPLE_LENGTH - 3, "...");
+  }
+}
+
+
+static void describe(sample_t *sample, data_t *d)
+{
+  if (sample_full(sample)) {
+    return;
+  }
+  switch (type_of(d)) {
+  case CONS_CELL_TYPE: {
+    data_t *cell;
+    append_to_sample(sample, "(");
+    for (cell = d; type_of(cell) == CONS_CELL_TYPE && !sample_full(sample); cell = cdr(cell)) {
+      describe(sample, car(cell));
+      append_to_sample(sample, " ");
+    }
+    if (cell != NULL && type_of(cell) != CONS_CELL_TYPE) {
+      append_to_sample(sample, ". ");
+      describe(sample, cell);
+      append_to_sample(sample, " ");
+    }
+    append_to_sample(sample, ")");
+    break;
+  }
+  case RECORD_TYPE: {
+    record_type_t *type = record_type_of(d);
+    append_to_sample(sample, "<");
+    append_to_sample(sample, type->name);
+    append_to_sample(sample, ":");
+    for (int i = 0; i < type->number_of_fields && !sample_full(sample); i++) {
+      append_to_sample(sample, " ");
+      describe(sample, d->data.record.slots[i]);
+    }
+    append_to_sample(sample, ">");
+    break;
+  }
+  case HASH_MAP_TYPE:
+    append_to_sample(sample, "{...}");
+    break;
+  case VECTOR_TYPE:
+    append_to_sample(sample, "[...]");
+    break;
+  default: {
+    char *str = to_string(d);
+    append_to_sample(sample, str);
+    free(str);
+    break;
+  }
+  }
+}
+
+
+static void print_sample(FILE *out, data_t *d)
+{
+  sample_t sample;
+  sample.length = 0;
+  sample.text[0] = '\0';
+  describe(&sample, d);
+  fprintf(out, "    node %d, %d references: %s", heap_index(d), d->meta.refs, sample.text);
+  char *site = allocation_site_of(heap_index(d));
+  if (site != NULL) {
+    fprintf(out, " (allocated in %s)", site);
+  }
+  fprintf(out, "\n");
+}
+
+
+int report_leaks(FILE *out)
+{
+  mark_state_t state;
+  state.marks = (char*)calloc(total_cells(), sizeof(char));
+  state.head = NULL;
+  vector_init(&state.pending);
+  mark_from_roots(&state);
+  mark_leaked_interiors(&state);
+
+  int leaked_by_type[STATS_CELL_TYPES] = {0};
+  int total_leaked = 0;
+  for (int i = 0; i < total_cells(); i++) {
+    data_t *d = heap_cell(i);
+    if (!freep(d) && state.marks[i] != REACHABLE && !reference_counting_exempt(d)) {
+      leaked_by_type[type_of(d)]++;
+      total_leaked++;
+    }
+  }
+
+  if (total_leaked == 0) {
+    fprintf(out, "No leaked cells.\n");
+  } else {
+    fprintf(out, "%d leaked cells:\n", total_leaked);
+    for (int type = 0; type < STATS_CELL_TYPES; type++) {
+      if (leaked_by_type[type] == 0) {
+        continue;
+      }
+      fprintf(out, "  %d %s\n", leaked_by_type[type], type_name(type));
+      int samples = 0;
+      for (int i = 0; i < total_cells() && samples < LEAK_SAMPLES_PER_TYPE; i++) {
+        data_t *d = heap_cell(i);
+        if (!freep(d) && type_of(d) == type && state.marks[i] == LEAKED_HEAD && !reference_counting_exempt(d)) {
+          print_sample(out, d);
+          samples++;
+        }
+      }
+    }
+  }
+
+  vector_free(&state.pending);
+  free(state.marks);
+  return total_leaked;
+}
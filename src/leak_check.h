@@ -0,0 +1,19 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the leak detector. */
+
+#ifndef __LEAK_CHECK_H
+#define __LEAK_CHECK_H
+
+#include <stdio.h>
+
+/* Reports allocated cells that can not be reached from any live environment
+   frame or from the data system's permanent cells, and returns how many
+   there were. */
+
+int report_leaks(FILE *out);
+
+#endif
@@ -14,11 +14,12 @@
 
 int number_of_handlers = 0;
 LogHandler log_handlers[MAX_NUMBER_OF_HANDLERS];
+LogDeferredHandler deferred_handler = NULL;
 
 
 const char *level_names[] = {"NOTSET", "DEBUG_DEEP", "DEBUG_MID", "DEBUG", "INFO", "WARNING", "ERROR", "CRITICAL"};
-LogLevel log_level;
-char log_buffer[1024];
+LogLevel log_current_level;
+THREAD_LOCAL char log_buffer[1024];
 
 void log_internal_log(LogLevel level, const char *format, va_list args);
 
@@ -91,21 +92,31 @@ bool log_add_handler(LogHandler handler)
 }
 
 
+void log_set_deferred_handler(LogDeferredHandler handler)
+{
+     deferred_handler = handler;
+}
+
+
 void log_set_level(LogLevel new_level)
 {
-     log_level = new_level;
+     log_current_level = new_level;
 }
 
 
 LogLevel log_get_level()
 {
-     return log_level;
+     return log_current_level;
 }
 
 
 void _internal_log(LogLevel level, const char *format, va_list args)
 {
-     if (level >= log_level) {
+     if (level >= log_current_level) {
+          if (deferred_handler) {
+               deferred_handler(level, format, args);
+               return;
+          }
           vsprintf(log_buffer, format, args);
           for (int i = 0; i < MAX_NUMBER_OF_HANDLERS; i++) {
                if (log_handlers[i]) {
@@ -116,7 +127,7 @@ void _internal_log(LogLevel level, const char *format, va_list args)
 }
 
 
-void log_raw(LogLevel level, const char *format, ...)
+void (log_raw)(LogLevel level, const char *format, ...)
 {
      va_list args;
      va_start (args, format);
@@ -125,7 +136,7 @@ void log_raw(LogLevel level, const char *format, ...)
 }
 
 
-void log_debug_deep(const char *format, ...)
+void (log_debug_deep)(const char *format, ...)
 {
      va_list args;
      va_start (args, format);
@@ -134,7 +145,7 @@ void log_debug_deep(const char *format, ...)
 }
 
 
-void log_debug_mid(const char *format, ...)
+void (log_debug_mid)(const char *format, ...)
 {
      va_list args;
      va_start (args, format);
@@ -143,7 +154,7 @@ void log_debug_mid(const char *format, ...)
 }
 
 
-void log_debug(const char *format, ...)
+void (log_debug)(const char *format, ...)
 {
      va_list args;
      va_start (args, format);
@@ -152,7 +163,7 @@ void log_debug(const char *format, ...)
 }
 
 
-void log_info(const char *format, ...)
+void (log_info)(const char *format, ...)
 {
      va_list args;
      va_start (args, format);
@@ -161,7 +172,7 @@ void log_info(const char *format, ...)
 }
 
 
-void log_warning(const char *format, ...)
+void (log_warning)(const char *format, ...)
 {
      va_list args;
      va_start (args, format);
@@ -170,7 +181,7 @@ void log_warning(const char *format, ...)
 }
 
 
-void log_error(const char *format, ...)
+void (log_error)(const char *format, ...)
 {
      va_list args;
      va_start (args, format);
@@ -179,7 +190,7 @@ void log_error(const char *format, ...)
 }
 
 
-void log_critical(const char *format, ...)
+void (log_critical)(const char *format, ...)
 {
      va_list args;
      va_start (args, format);
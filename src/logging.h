@@ -29,17 +29,36 @@
 typedef enum { NOTSET, DEBUG_DEEP, DEBUG_MID, DEBUG, INFO, WARNING, ERROR, CRITICAL } LogLevel;
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include "logging_handler.h"
 
+/* Storage private to each thread; the MCU only has the one */
+
+#ifdef ARDUINO
+#define THREAD_LOCAL
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef void (*LogHandler)(const char *level_name, const char *msg);
 
-const char *log_name_level_for(LogLevel level);
+/* A deferred handler takes each message unformatted, in place of the
+   handlers, so formatting can happen off the hot path */
+typedef void (*LogDeferredHandler)(LogLevel level, const char *format, va_list args);
+
+const char *log_name_for_level(LogLevel level);
 LogLevel log_level_for(const char *level_name);
+LogLevel log_get_level(void);
 
 void log_init_logger(LogHandler handler);
 void log_set_level(LogLevel new_level);
 void log_set_handler(LogHandler handler);
 bool log_add_handler(LogHandler handler);
+void log_set_deferred_handler(LogDeferredHandler handler);
 void log_raw(LogLevel level, const char *format, ...);
 void log_debug_deep(const char *format, ...);
 void log_debug_mid(const char *format, ...);
@@ -49,4 +68,33 @@ void log_warning(const char *format, ...);
 void log_error(const char *format, ...);
 void log_critical(const char *format, ...);
 
+extern LogLevel log_current_level;
+
+#ifdef __cplusplus
+}
+#endif
+
+/* Messages below LOG_MIN_LEVEL are compiled out: the level test is a
+   constant, so the call, its arguments and its format string all vanish.
+   Build release firmware with e.g. -DLOG_MIN_LEVEL=INFO.  Above it, the
+   runtime level is tested before the arguments are evaluated.  Code that
+   does work just to build a message should be guarded by log_enabled. */
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL NOTSET
+#endif
+
+#define log_enabled(level) ((level) >= LOG_MIN_LEVEL && (level) >= log_current_level)
+
+#define LOG_AT(level, function, ...) do { if (log_enabled(level)) (function)(__VA_ARGS__); } while (0)
+
+#define log_raw(level, ...) LOG_AT(level, log_raw, level, __VA_ARGS__)
+#define log_debug_deep(...) LOG_AT(DEBUG_DEEP, log_debug_deep, __VA_ARGS__)
+#define log_debug_mid(...) LOG_AT(DEBUG_MID, log_debug_mid, __VA_ARGS__)
+#define log_debug(...) LOG_AT(DEBUG, log_debug, __VA_ARGS__)
+#define log_info(...) LOG_AT(INFO, log_info, __VA_ARGS__)
+#define log_warning(...) LOG_AT(WARNING, log_warning, __VA_ARGS__)
+#define log_error(...) LOG_AT(ERROR, log_error, __VA_ARGS__)
+#define log_critical(...) LOG_AT(CRITICAL, log_critical, __VA_ARGS__)
+
 #endif
@@ -5,33 +5,40 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include "logging.h"
 #include "logging_handler.h"
 
 
-char _buffer[256];
+THREAD_LOCAL char _buffer[256];
 
 
 /*
- Returns the current time.
+ Returns the given time as text.
 */
 
-char *time_stamp(){
-     char *timestamp = (char *)malloc(sizeof(char) * 16);
-     time_t ltime;
-     ltime = time(NULL);
-     struct tm *tm;
-     tm = localtime(&ltime);
+char *time_stamp(time_t ltime){
+     char *timestamp = (char *)malloc(sizeof(char) * 20);
+     struct tm tm;
+     localtime_r(&ltime, &tm);
 
-     sprintf(timestamp,"%04d/%02d/%02d %02d:%02d:%02d", tm->tm_year+1900, tm->tm_mon,
-             tm->tm_mday, tm->tm_hour, tm->tm_min, tm->tm_sec);
+     sprintf(timestamp,"%04d/%02d/%02d %02d:%02d:%02d", tm.tm_year+1900, tm.tm_mon,
+             tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
      return timestamp;
 }
 
 
 char *log_format(const char *level_name, const char *msg)
 {
-     char *tod = time_stamp();
-     sprintf(_buffer, "%s - %10s: %s", tod, level_name, msg);
+     return log_format_at(level_name, msg, time(NULL));
+}
+
+
+/* For messages formatted after the fact, stamped with when they were logged */
+
+char *log_format_at(const char *level_name, const char *msg, time_t when)
+{
+     char *tod = time_stamp(when);
+     snprintf(_buffer, sizeof(_buffer), "%s - %10s: %s", tod, level_name, msg);
      free(tod);
      return _buffer;
 }
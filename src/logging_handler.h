@@ -6,7 +6,10 @@
 #define __LOGGING_HANDLER_H__
 
 
+#include <time.h>
+
 char *log_format(const char *level_name, const char *msg);
+char *log_format_at(const char *level_name, const char *msg, time_t when);
 
 
 #endif
@@ -13,20 +13,45 @@
 #include "primitives.h"
 #include "logging.h"
 #include "serial_handler.h"
+#include "ring_handler.h"
+#include "interp.h"
+
+/* How many evaluation steps run between calls back to the sketch */
+
+#define STEPS_BETWEEN_SERVICES 1000
+
+/* Provided by the sketch: does whatever loop() must do often, such as
+   servicing the radio and the watchdog */
+
+extern void service_c(void);
+
+
+/* Lets a long evaluation give the board its time */
+
+bool service_during_evaluation(void)
+{
+     ring_handler_drain();
+     service_c();
+     return true;
+}
+
 
 void setup_c()
 {
      serial_handler_init(0);
      log_init_logger(&serial_handler);
+     ring_handler_init(&serial_write_line);
      log_set_level(INFO);
      log_info("Initializing");
      initialize_lisp_data_system();
      initialize_environment();
      register_special_forms();
      register_primitives();
+     set_step_budget(STEPS_BETWEEN_SERVICES, &service_during_evaluation);
 }
 
 
 void loop_c()
 {
+     ring_handler_drain();
 }
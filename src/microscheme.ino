@@ -16,6 +16,10 @@
 extern "C" void setup_c();
 extern "C" void loop_c();
 
+// Called every so many steps while Scheme code is evaluating, so keep
+// anything that must run often in here.
+extern "C" void service_c() { yield(); }
+
 void setup() { setup_c(); }
 void loop()  { loop_c(); }
 
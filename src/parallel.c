@@ -0,0 +1,824 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains parallel mapping across interpreter isolates. */
+
+/* An interpreter's heap and environments can only be used by one thread,
+   so each worker thread keeps an isolate (an interpreter of its own),
+   copies what the function needs into it for each map, and copies each
+   result back into the caller's heap.  The threads and their isolates are
+   started by the first map that needs them and then wait for the next;
+   after each map a worker drops the globals it copied or defined.
+
+   Items are split evenly between the workers up front.  A worker takes
+   items from the front of its own range, and one that runs out steals the
+   back half of another's, so uneven work still keeps every core busy.
+
+   The caller's heap is only read while the workers run, except to copy
+   results back, which the workers take turns at.  Closures are copied
+   along with the frames they captured.  Globals are copied when the
+   function (or anything it refers to) mentions them, so assignments to
+   globals in a worker are not seen by the caller.  Copied records share
+   their record type with the original.  String builders can't be
+   copied. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#ifndef ARDUINO
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#endif
+#include "data.h"
+#include "environment_frame.h"
+#include "evaluator.h"
+#include "interp.h"
+#include "vector.h"
+#include "heap_profile.h"
+#include "profiler.h"
+#include "sampler.h"
+#include "tracer.h"
+#include "logging.h"
+#include "parallel.h"
+
+#define MAX_WORKERS 16
+
+static int configured_workers = 0;
+
+
+void set_parallel_workers(int number_of_workers)
+{
+  configured_workers = number_of_workers;
+}
+
+
+/********************************************************************************/
+/* copying between interpreters                                                 */
+/********************************************************************************/
+
+typedef struct frame_copy_t {
+  environment_frame_t *from;
+  environment_frame_t *to;
+} frame_copy_t;
+
+/* Copies are made into the current interpreter.  Frames are remembered so
+   closures that share a frame still share its copy. */
+
+typedef struct copier_t {
+  environment_frame_t *from_global;
+  environment_frame_t *to_global;
+  frame_copy_t *frames;
+  int number_of_frames;
+  char *err;
+} copier_t;
+
+
+static void start_copy(copier_t *copier, environment_frame_t *from_global)
+{
+  copier->from_global = from_global;
+  copier->to_global = GLOBAL_ENV;
+  copier->frames = NULL;
+  copier->number_of_frames = 0;
+  copier->err = NULL;
+}
+
+
+/* Lets the copied frames go once only the copied closures hold them */
+
+static void finish_copy(copier_t *copier)
+{
+  for (int i = copier->number_of_frames - 1; i >= 0; i--) {
+    go_out_of_scope(copier->frames[i].to);
+  }
+  free(copier->frames);
+  copier->frames = NULL;
+  copier->number_of_frames = 0;
+}
+
+
+static data_t *copy_value(copier_t *copier, data_t *d);
+
+
+static environment_frame_t *copy_frame(copier_t *copier, environment_frame_t *from)
+{
+  if (from == NULL) {
+    return NULL;
+  }
+  if (from == copier->from_global) {
+    return copier->to_global;
+  }
+  for (int i = 0; i < copier->number_of_frames; i++) {
+    if (copier->frames[i].from == from) {
+      return copier->frames[i].to;
+    }
+  }
+
+  environment_frame_t *to = new_environment_frame_below(copy_frame(copier, from->parent));
+  copier->frames = (frame_copy_t*)realloc(copier->frames, (copier->number_of_frames + 1) * sizeof(frame_copy_t));
+  copier->frames[copier->number_of_frames].from = from;
+  copier->frames[copier->number_of_frames].to = to;
+  copier->number_of_frames++;
+
+  for (DNODE *node = from->bindings->start; node != NULL && copier->err == NULL; node = node->next) {
+    binding_t *binding = (binding_t*)node->data;
+    bind_symbol(to, intern_symbol(string_value(binding->sym)), copy_value(copier, binding->val));
+  }
+  return to;
+}
+
+
+/* Primitives are shared rather than copied, using the destination's own
+   cell when it has the same primitive under the same name */
+
+static data_t *copy_primitive(copier_t *copier, primitive_function_t *prim)
+{
+  primitive_function_t *existing = prim_value(value_of(copier->to_global, intern_symbol(prim->name)));
+  if (existing != NULL && existing->impl == prim->impl && existing->context_impl == prim->context_impl && existing->context == prim->context) {
+    return value_of(copier->to_global, intern_symbol(prim->name));
+  }
+  return prim_with_value(prim);
+}
+
+
+static data_t *copy_list(copier_t *copier, data_t *l)
+{
+  data_t *head = cons(copy_value(copier, car(l)), NULL);
+  data_t *tail = head;
+  for (l = cdr(l); type_of(l) == CONS_CELL_TYPE && copier->err == NULL; l = cdr(l)) {
+    data_t *cell = cons(copy_value(copier, car(l)), NULL);
+    set_cdr(tail, retain(cell));
+    tail = cell;
+  }
+  if (l != NULL && copier->err == NULL) {
+    set_cdr(tail, retain(copy_value(copier, l)));
+  }
+  return head;
+}
+
+
+/* Record types are never freed, so a copied record shares its type with
+   the original and the copied accessors still recognise it */
+
+static data_t *copy_record(copier_t *copier, data_t *from)
+{
+  record_type_t *type = record_type_of(from);
+  data_t *record = record_with_type(type);
+  for (int i = 0; i < type->number_of_fields && copier->err == NULL; i++) {
+    record->data.record.slots[i] = retain(copy_value(copier, from->data.record.slots[i]));
+  }
+  return record;
+}
+
+
+typedef struct map_copy_t {
+  copier_t *copier;
+  hamt_node_t *root;
+  int count;
+} map_copy_t;
+
+
+static void copy_map_entry(data_t *key, data_t *value, void *context)
+{
+  map_copy_t *copy = (map_copy_t*)context;
+  data_t *key_copy = retain(copy_value(copy->copier, key));
+  data_t *value_copy = retain(copy_value(copy->copier, value));
+  if (copy->copier->err == NULL) {
+    bool added;
+    hamt_node_t *updated = hamt_assoc(copy->root, key_copy, value_copy, &added);
+    hamt_release(copy->root);
+    copy->root = updated;
+    if (added) {
+      copy->count++;
+    }
+  }
+  release(key_copy);
+  release(value_copy);
+}
+
+
+static data_t *copy_hash_map(copier_t *copier, data_t *from)
+{
+  map_copy_t copy = { .copier = copier, .root = NULL, .count = 0 };
+  hamt_for_each(hash_map_root(from), &copy_map_entry, &copy);
+  return hash_map_with_root(copy.root, copy.count);
+}
+
+
+static data_t *copy_vector(copier_t *copier, pvector_t *from)
+{
+  pvector_t *v = pvector_empty();
+  for (int i = 0; i < from->count && copier->err == NULL; i++) {
+    data_t *item = retain(copy_value(copier, pvector_ref(from, i)));
+    pvector_t *pushed = pvector_push(v, item);
+    pvector_release(v);
+    v = pushed;
+    release(item);
+  }
+  return pvector_with_value(v);
+}
+
+
+/* Copies a value from another interpreter into the current one.  Sets the
+   copier's error, and returns NULL, for a value that can't be copied. */
+
+static data_t *copy_value(copier_t *copier, data_t *d)
+{
+  if (d == NULL || copier->err != NULL) {
+    return NULL;
+  }
+  switch (type_of(d)) {
+  case INTEGER_TYPE:
+    return integer_with_value(integer_value(d));
+  case UNSIGNED_INTEGER_TYPE:
+    return unsigned_integer_with_value(unsigned_integer_value(d));
+  case BOOLEAN_TYPE:
+    return boolean_with_value(boolean_value(d));
+  case STRING_TYPE: {
+    int length = string_length(d);
+    char *chars = (char*)malloc(length + 1);
+    memcpy(chars, string_chars(d), length);
+    chars[length] = '\0';
+    return string_with_length(chars, length);
+  }
+  case SYMBOL_TYPE:
+    return intern_symbol(string_value(d));
+  case CONS_CELL_TYPE:
+    return copy_list(copier, d);
+  case PRIMITIVE_TYPE:
+    return copy_primitive(copier, prim_value(d));
+  case FUNCTION_TYPE: {
+    function_t *func = func_value(d);
+    environment_frame_t *env = copy_frame(copier, func->env);
+    data_t *parameters = copy_value(copier, func->parameters);
+    data_t *body = copy_value(copier, func->body);
+    return func_with_value(make_function(strdup(func->name), parameters, body, env));
+  }
+  case MACRO_TYPE: {
+    macro_t *macro = macro_value(d);
+    environment_frame_t *env = copy_frame(copier, macro->env);
+    data_t *parameters = copy_value(copier, macro->parameters);
+    data_t *body = copy_value(copier, macro->body);
+    return macro_with_value(make_macro(strdup(macro->name), parameters, body, env));
+  }
+  case RECORD_TYPE:
+    return copy_record(copier, d);
+  case RECORD_DESCRIPTOR_TYPE:
+    return record_type_with_value(record_type_value(d));
+  case HASH_MAP_TYPE:
+    return copy_hash_map(copier, d);
+  case VECTOR_TYPE:
+    return copy_vector(copier, pvector_value(d));
+  default: {
+    char *type = type_name(type_of(d));
+    copier->err = (char*)malloc(48 + strlen(type));
+    sprintf(copier->err, "pmap can't copy a %s between interpreters", type);
+    return NULL;
+  }
+  }
+}
+
+
+/* Copies a value, handing back an error instead of a partial copy */
+
+static data_t *copy_whole_value(copier_t *copier, data_t *d, char **err_ptr)
+{
+  data_t *copy = copy_value(copier, d);
+  if (copier->err != NULL) {
+    release(retain(copy));
+    *err_ptr = copier->err;
+    copier->err = NULL;
+    return NULL;
+  }
+  return copy;
+}
+
+
+/********************************************************************************/
+/* finding the globals a function needs                                         */
+/********************************************************************************/
+
+typedef struct scan_t {
+  environment_frame_t *global;
+  Vector symbols;
+  environment_frame_t **frames;
+  int number_of_frames;
+} scan_t;
+
+
+static void scan_value(scan_t *scan, data_t *d);
+
+
+static void scan_map_entry(data_t *key, data_t *value, void *context)
+{
+  scan_value((scan_t*)context, key);
+  scan_value((scan_t*)context, value);
+}
+
+
+static void scan_frame(scan_t *scan, environment_frame_t *frame)
+{
+  for (; frame != NULL && frame != scan->global; frame = frame->parent) {
+    for (int i = 0; i < scan->number_of_frames; i++) {
+      if (scan->frames[i] == frame) {
+        return;
+      }
+    }
+    scan->frames = (environment_frame_t**)realloc(scan->frames, (scan->number_of_frames + 1) * sizeof(environment_frame_t*));
+    scan->frames[scan->number_of_frames++] = frame;
+    for (DNODE *node = frame->bindings->start; node != NULL; node = node->next) {
+      scan_value(scan, ((binding_t*)node->data)->val);
+    }
+  }
+}
+
+
+/* A global needs copying unless it's a primitive every interpreter
+   registers under that name; record procedures carry their record type as
+   context and are made by define-record-type instead */
+
+static void scan_symbol(scan_t *scan, data_t *symbol)
+{
+  for (int i = 0; i < scan->symbols.size; i++) {
+    if (scan->symbols.data[i] == symbol) {
+      return;
+    }
+  }
+  binding_t *binding = dictionary_get(scan->global->bindings, string_value(symbol));
+  if (binding == NULL) {
+    return;
+  }
+  primitive_function_t *prim = prim_value(binding->val);
+  if (prim != NULL && prim->foreign == NULL && prim->context == NULL && strcmp(prim->name, string_value(symbol)) == 0) {
+    return;
+  }
+  vector_append(&scan->symbols, symbol);
+  scan_value(scan, binding->val);
+}
+
+
+static void scan_value(scan_t *scan, data_t *d)
+{
+  for (; d != NULL; d = cdr(d)) {
+    switch (type_of(d)) {
+    case SYMBOL_TYPE:
+      scan_symbol(scan, d);
+      return;
+    case FUNCTION_TYPE:
+      scan_value(scan, func_value(d)->body);
+      scan_frame(scan, func_value(d)->env);
+      return;
+    case MACRO_TYPE:
+      scan_value(scan, macro_value(d)->body);
+      scan_frame(scan, macro_value(d)->env);
+      return;
+    case CONS_CELL_TYPE:
+      scan_value(scan, car(d));
+      break;
+    case RECORD_TYPE:
+      for (int i = 0; i < record_type_of(d)->number_of_fields; i++) {
+        scan_value(scan, d->data.record.slots[i]);
+      }
+      return;
+    case HASH_MAP_TYPE:
+      hamt_for_each(hash_map_root(d), &scan_map_entry, scan);
+      return;
+    case VECTOR_TYPE:
+      for (int i = 0; i < pvector_value(d)->count; i++) {
+        scan_value(scan, pvector_ref(pvector_value(d), i));
+      }
+      return;
+    default:
+      return;
+    }
+  }
+}
+
+
+/********************************************************************************/
+/* work stealing pool                                                           */
+/********************************************************************************/
+
+#ifndef ARDUINO
+
+/* Each worker's share of the items, as the next index in the high word and
+   the end in the low word, so taking and stealing are single swaps */
+
+#define RANGE(next, end) (((uint64_t)(next) << 32) | (uint32_t)(end))
+#define RANGE_NEXT(range) ((int)((range) >> 32))
+#define RANGE_END(range) ((int)((range) & 0xFFFFFFFF))
+
+typedef struct parallel_job_t {
+  interp_t *caller;
+  data_t *function;
+  Vector globals;
+  data_t **items;
+  data_t **results;
+  char **errors;
+  int number_of_items;
+  bool collect;
+  atomic_bool failed;
+  pthread_mutex_t caller_lock;
+  int number_of_workers;
+  int unfinished;
+} parallel_job_t;
+
+/* A worker thread and its isolate outlive the jobs they run; the globals
+   the isolate started with are remembered so each job can be undone */
+
+typedef struct worker_t {
+  int number;
+  _Atomic uint64_t range;
+  pthread_t thread;
+  interp_t *isolate;
+  dictionary_t *initial_globals;
+  char *err;
+} worker_t;
+
+/* One job runs at a time; it's handed over by bumping the generation */
+
+typedef struct pool_t {
+  pthread_mutex_t lock;
+  pthread_cond_t job_ready;
+  pthread_cond_t job_done;
+  parallel_job_t *job;
+  unsigned long generation;
+  int number_of_threads;
+  worker_t workers[MAX_WORKERS];
+} pool_t;
+
+static pool_t pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .job_ready = PTHREAD_COND_INITIALIZER,
+  .job_done = PTHREAD_COND_INITIALIZER
+};
+
+static THREAD_LOCAL bool in_worker = false;
+
+
+static bool take_item(worker_t *worker, int *index)
+{
+  uint64_t range = atomic_load(&worker->range);
+  while (RANGE_NEXT(range) < RANGE_END(range)) {
+    if (atomic_compare_exchange_weak(&worker->range, &range, RANGE(RANGE_NEXT(range) + 1, RANGE_END(range)))) {
+      *index = RANGE_NEXT(range);
+      return true;
+    }
+  }
+  return false;
+}
+
+
+/* Takes the back half of the first other worker's range that has any
+   items left, making it this worker's range */
+
+static bool steal_items(worker_t *thief, parallel_job_t *job)
+{
+  for (int i = 1; i < job->number_of_workers; i++) {
+    worker_t *victim = &pool.workers[(thief->number + i) % job->number_of_workers];
+    uint64_t range = atomic_load(&victim->range);
+    while (RANGE_NEXT(range) < RANGE_END(range)) {
+      int taken = (RANGE_END(range) - RANGE_NEXT(range) + 1) / 2;
+      int split = RANGE_END(range) - taken;
+      if (atomic_compare_exchange_weak(&victim->range, &range, RANGE(RANGE_NEXT(range), split))) {
+        atomic_store(&thief->range, RANGE(split, RANGE_END(range)));
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+static bool next_item(worker_t *worker, parallel_job_t *job, int *index)
+{
+  while (!atomic_load(&job->failed)) {
+    if (take_item(worker, index)) {
+      return true;
+    }
+    if (!steal_items(worker, job)) {
+      return false;
+    }
+  }
+  return false;
+}
+
+
+/* Copies the globals the function refers to, then the function itself,
+   into the worker's interpreter */
+
+static data_t *prepare_isolate(parallel_job_t *job, char **err_ptr)
+{
+  copier_t copier;
+  start_copy(&copier, job->caller->global_env);
+  for (int i = 0; i < job->globals.size && *err_ptr == NULL; i++) {
+    data_t *symbol = job->globals.data[i];
+    binding_t *binding = dictionary_get(job->caller->global_env->bindings, string_value(symbol));
+    data_t *value = copy_whole_value(&copier, binding->val, err_ptr);
+    if (*err_ptr == NULL) {
+      bind_symbol(GLOBAL_ENV, intern_symbol(string_value(symbol)), value);
+    }
+  }
+  data_t *function = NULL;
+  if (*err_ptr == NULL) {
+    function = retain(copy_whole_value(&copier, job->function, err_ptr));
+  }
+  finish_copy(&copier);
+  return function;
+}
+
+
+static void remember_globals(worker_t *worker)
+{
+  worker->initial_globals = new_dictionary();
+  for (DNODE *node = GLOBAL_ENV->bindings->start; node != NULL; node = node->next) {
+    binding_t *binding = (binding_t*)node->data;
+    binding_t *initial = (binding_t*)malloc(sizeof(binding_t));
+    initial->sym = binding->sym;
+    initial->val = retain(binding->val);
+    dictionary_put(worker->initial_globals, node->key, initial);
+  }
+}
+
+
+/* Drops the globals a job copied in or defined, and puts back any it
+   replaced, so the next job starts from the freshly made isolate */
+
+static void restore_globals(worker_t *worker)
+{
+  DNODE *next;
+  for (DNODE *node = GLOBAL_ENV->bindings->start; node != NULL; node = next) {
+    next = node->next;
+    binding_t *binding = (binding_t*)node->data;
+    binding_t *initial = (binding_t*)dictionary_get(worker->initial_globals, node->key);
+    if (initial == NULL) {
+      release(binding->val);
+      dictionary_remove(GLOBAL_ENV->bindings, node->key);
+      free(binding);
+    } else if (binding->val != initial->val) {
+      rebind(GLOBAL_ENV, binding->sym, initial->val);
+    }
+  }
+}
+
+
+/* Applies the function to one item, copying the result back to the caller
+   if it's wanted */
+
+static void map_item(parallel_job_t *job, data_t *function, int index)
+{
+  char *err = NULL;
+  copier_t copier;
+  start_copy(&copier, job->caller->global_env);
+  data_t *item = copy_whole_value(&copier, job->items[index], &err);
+  finish_copy(&copier);
+  if (err != NULL) {
+    job->errors[index] = err;
+    return;
+  }
+
+  data_t *arguments = retain(cons(item, NULL));
+  environment_frame_t *frame = NULL;
+  data_t *value = retain(apply_to_values(function, arguments, GLOBAL_ENV, &frame, &err));
+  release_call_frame(frame);
+  release(arguments);
+
+  if (err == NULL && job->collect) {
+    pthread_mutex_lock(&job->caller_lock);
+    interp_t *isolate = enter_interp(job->caller);
+    start_copy(&copier, isolate->global_env);
+    job->results[index] = retain(copy_whole_value(&copier, value, &err));
+    finish_copy(&copier);
+    enter_interp(isolate);
+    pthread_mutex_unlock(&job->caller_lock);
+  }
+  release(value);
+  job->errors[index] = err;
+}
+
+
+static void run_job(worker_t *worker, parallel_job_t *job)
+{
+  data_t *function = prepare_isolate(job, &worker->err);
+  if (worker->err != NULL) {
+    atomic_store(&job->failed, true);
+  }
+
+  int index;
+  while (next_item(worker, job, &index)) {
+    map_item(job, function, index);
+    if (job->errors[index] != NULL) {
+      atomic_store(&job->failed, true);
+    }
+  }
+
+  release(function);
+  restore_globals(worker);
+}
+
+
+static void *run_worker(void *argument)
+{
+  worker_t *worker = (worker_t*)argument;
+  in_worker = true;
+  worker->isolate = new_interp();
+  enter_interp(worker->isolate);
+  remember_globals(worker);
+
+  unsigned long seen = 0;
+  pthread_mutex_lock(&pool.lock);
+  while (true) {
+    while (pool.generation == seen) {
+      pthread_cond_wait(&pool.job_ready, &pool.lock);
+    }
+    seen = pool.generation;
+    parallel_job_t *job = pool.job;
+    if (worker->number >= job->number_of_workers) {
+      continue;
+    }
+    pthread_mutex_unlock(&pool.lock);
+    run_job(worker, job);
+    pthread_mutex_lock(&pool.lock);
+    if (--job->unfinished == 0) {
+      pthread_cond_broadcast(&pool.job_done);
+    }
+  }
+  return NULL;
+}
+
+
+/* fork copies the pool but not its threads, so a child starts its own */
+
+static void forget_pool(void)
+{
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init(&pool.job_ready, NULL);
+  pthread_cond_init(&pool.job_done, NULL);
+  pool.job = NULL;
+  pool.number_of_threads = 0;
+}
+
+
+/* Tops the pool up to the number of threads wanted, returning how many
+   there are.  Signals stay with the caller's thread, so a server's poll
+   still wakes for them. */
+
+static int start_threads(int wanted)
+{
+  static bool watching_forks = false;
+  if (!watching_forks) {
+    pthread_atfork(NULL, NULL, &forget_pool);
+    watching_forks = true;
+  }
+  sigset_t all, previous;
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &previous);
+  while (pool.number_of_threads < wanted) {
+    worker_t *worker = &pool.workers[pool.number_of_threads];
+    worker->number = pool.number_of_threads;
+    if (pthread_create(&worker->thread, NULL, &run_worker, worker) != 0) {
+      break;
+    }
+    pthread_detach(worker->thread);
+    pool.number_of_threads++;
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, NULL);
+  return pool.number_of_threads;
+}
+
+
+/* Builds the list of results, or picks the error from the earliest item,
+   then lets go of everything the workers left behind */
+
+static data_t *finish_job(parallel_job_t *job, char **err_ptr)
+{
+  data_t *result = NULL;
+  for (int i = job->number_of_workers - 1; i >= 0; i--) {
+    if (pool.workers[i].err != NULL) {
+      free(*err_ptr);
+      *err_ptr = pool.workers[i].err;
+      pool.workers[i].err = NULL;
+    }
+  }
+  for (int i = job->number_of_items - 1; i >= 0; i--) {
+    if (job->errors[i] != NULL) {
+      free(*err_ptr);
+      *err_ptr = job->errors[i];
+    }
+  }
+  if (*err_ptr == NULL && job->collect) {
+    for (int i = job->number_of_items - 1; i >= 0; i--) {
+      result = cons(job->results[i], result);
+    }
+  }
+  if (result != NULL) {
+    retain(result);
+  }
+  for (int i = 0; i < job->number_of_items; i++) {
+    release(job->results[i]);
+  }
+  return result == NULL ? NULL : disown(result);
+}
+
+
+int parallel_workers_for(int number_of_items)
+{
+  if (in_worker || profiling || sampling || tracing || heap_profiling) {
+    return 1;
+  }
+  int workers = configured_workers;
+  if (workers <= 0) {
+    workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  if (workers > MAX_WORKERS) {
+    workers = MAX_WORKERS;
+  }
+  return (workers < number_of_items) ? workers : number_of_items;
+}
+
+
+/* Interpreters on other threads that map at the same time take turns with
+   the pool */
+
+data_t *parallel_map(data_t *function, data_t *list, bool collect, char **err_ptr)
+{
+  *err_ptr = NULL;
+  parallel_job_t *job = (parallel_job_t*)calloc(1, sizeof(parallel_job_t));
+  job->caller = current_interp;
+  job->function = function;
+  job->collect = collect;
+  job->number_of_items = length_of(list);
+  job->number_of_workers = parallel_workers_for(job->number_of_items);
+  job->items = (data_t**)malloc(job->number_of_items * sizeof(data_t*));
+  job->results = (data_t**)calloc(job->number_of_items, sizeof(data_t*));
+  job->errors = (char**)calloc(job->number_of_items, sizeof(char*));
+  atomic_init(&job->failed, false);
+  pthread_mutex_init(&job->caller_lock, NULL);
+
+  int index = 0;
+  for (data_t *cell = list; cell != NULL; cell = cdr(cell)) {
+    job->items[index++] = car(cell);
+  }
+
+  scan_t scan = { .global = GLOBAL_ENV, .frames = NULL, .number_of_frames = 0 };
+  vector_init(&scan.symbols);
+  scan_value(&scan, function);
+  free(scan.frames);
+  job->globals = scan.symbols;
+
+  pthread_mutex_lock(&pool.lock);
+  while (pool.job != NULL) {
+    pthread_cond_wait(&pool.job_done, &pool.lock);
+  }
+  int threads = start_threads(job->number_of_workers);
+  data_t *result = NULL;
+  if (threads == 0) {
+    *err_ptr = strdup("Could not start any parallel map workers");
+  } else {
+    /* A worker that couldn't start leaves its items to be stolen */
+    for (int i = 0; i < job->number_of_workers; i++) {
+      atomic_store(&pool.workers[i].range, RANGE(job->number_of_items * i / job->number_of_workers,
+                                                 job->number_of_items * (i + 1) / job->number_of_workers));
+      pool.workers[i].err = NULL;
+    }
+    job->unfinished = (threads < job->number_of_workers) ? threads : job->number_of_workers;
+    pool.job = job;
+    pool.generation++;
+    pthread_cond_broadcast(&pool.job_ready);
+    while (job->unfinished > 0) {
+      pthread_cond_wait(&pool.job_done, &pool.lock);
+    }
+    result = finish_job(job, err_ptr);
+    pool.job = NULL;
+    pthread_cond_broadcast(&pool.job_done);
+  }
+  pthread_mutex_unlock(&pool.lock);
+
+  pthread_mutex_destroy(&job->caller_lock);
+  vector_free(&job->globals);
+  free(job->items);
+  free(job->results);
+  free(job->errors);
+  free(job);
+  return result;
+}
+
+#else
+
+int parallel_workers_for(int number_of_items)
+{
+  return 1;
+}
+
+
+data_t *parallel_map(data_t *function, data_t *list, bool collect, char **err_ptr)
+{
+  *err_ptr = strdup("Parallel maps need threads");
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,31 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains parallel mapping across interpreter isolates. */
+
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#include <stdbool.h>
+#include "data.h"
+
+/* Sets how many threads a parallel map may use; 0 means one per core */
+
+void set_parallel_workers(int number_of_workers);
+
+/* How many threads a parallel map over that many items would use.  Below
+   two the caller should map sequentially instead. */
+
+int parallel_workers_for(int number_of_items);
+
+/* Applies the function to each item of the list on a pool of threads, each
+   running its own interpreter.  The function, the globals it refers to and
+   each item are copied into the worker's interpreter, and each result is
+   copied back.  Returns the list of results when collecting, otherwise
+   NULL. */
+
+data_t *parallel_map(data_t *function, data_t *list, bool collect, char **err_ptr);
+
+#endif
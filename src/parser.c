@@ -17,6 +17,7 @@
 #include "tokenizer.h"
 #include "utils.h"
 #include "logging.h"
+#include "interp.h"
 
 data_t *make_integer(char *lit, char **err_ptr)
 {
@@ -58,6 +59,20 @@ data_t *make_symbol(char *lit, char **err_ptr)
   return intern_symbol(lit);
 }
 
+/* Name of the source being parsed, used to name anonymous functions */
+
+void set_source_name(char *name)
+{
+  current_interp->source_name = name;
+}
+
+
+char *get_source_name(void)
+{
+  return current_interp->source_name;
+}
+
+
 data_t *parse_expression(bool *, char **); /* forward ref */
 
 data_t *parse_cons_cell(bool *eof, char **err_ptr)
@@ -156,12 +171,20 @@ data_t *parse_expression(bool *eof, char **err_ptr)
       }
       return d;
     case LPAREN:
-      consume_token();
-      d = parse_cons_cell(eof, err_ptr);
-      if (*err_ptr != NULL) {
-        return NULL;
+      {
+        int line = get_line();
+        consume_token();
+        d = parse_cons_cell(eof, err_ptr);
+        if (*err_ptr != NULL) {
+          return NULL;
+        }
+        /* Every cell of the list remembers where the list opened, so special
+           forms handed its tail (like lambda) can tell where they came from */
+        for (data_t *cell = d; type_of(cell) == CONS_CELL_TYPE; cell = cdr(cell)) {
+          cell->meta.line = line;
+        }
+        return d;
       }
-      return d;
     case QUOTE:
       consume_token();
       return internal_make_list(2, intern_symbol("quote"), parse_expression(eof, err_ptr));
@@ -218,19 +241,22 @@ data_t *parse_and_eval_all(char *source, char **err_ptr)
   data_t *sexpr;
   data_t *result = NULL;
   initialize_tokenizer(source);
-  while (!eof_flag) {
-    release(result);
+  while (true) {
     sexpr = parse_expression(&eof_flag, err_ptr);
     if (*err_ptr != NULL) {
       return NULL;
     }
-    if (!eof_flag) {
-      result = evaluate(sexpr, GLOBAL_ENV, err_ptr);
-      release(sexpr);
-      if (*err_ptr != NULL) {
-        return NULL;
-      }
+    if (eof_flag) {
+      return result;
+    }
+    /* Only the last result is handed back; earlier ones may still be bound */
+    if (unreferencedp(result)) {
+      release(result);
+    }
+    result = evaluate(sexpr, GLOBAL_ENV, err_ptr);
+    release(sexpr);
+    if (*err_ptr != NULL) {
+      return NULL;
     }
   }
-  return result;
 }
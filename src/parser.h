@@ -14,6 +14,8 @@
 data_t *parse(char *, char **);
 data_t *parse_and_eval(char *source, char **err_ptr);
 data_t *parse_and_eval_all(char *source, char **err_ptr);
+void set_source_name(char *name);
+char *get_source_name(void);
 
 #define __PARSER_H
 #endif
@@ -13,17 +13,28 @@
 #include "utils.h"
 #include "environment_frame.h"
 #include "primitive_function.h"
+#include "interp.h"
 
 
 void register_primitive(char *name, int arg_count, primitive_function_impl impl)
 {
-  bind(GLOBAL_ENV, intern_symbol(name), prim_with_value(make_primitive_function(name, arg_count, false, impl)));
+  bind_symbol(GLOBAL_ENV, intern_symbol(name), prim_with_value(make_primitive_function(name, arg_count, false, impl)));
 }
 
 
 void register_special_form(char *name, int arg_count, primitive_function_impl impl)
 {
-  bind(GLOBAL_ENV, intern_symbol(name), prim_with_value(make_primitive_function(name, arg_count, true, impl)));
+  bind_symbol(GLOBAL_ENV, intern_symbol(name), prim_with_value(make_primitive_function(name, arg_count, true, impl)));
 }
 
 
+
+
+data_t *invoke_primitive(primitive_function_t *prim, data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  if (prim->context_impl != NULL) {
+    return prim->context_impl(prim->context, args, env, err_ptr);
+  } else {
+    return prim->impl(args, env, err_ptr);
+  }
+}
@@ -10,18 +10,24 @@
 
 typedef struct data_t data_t;
 typedef struct environment_frame_t environment_frame_t;
+typedef struct foreign_function_t foreign_function_t;
 
 typedef data_t*(*primitive_function_impl)(data_t *args, environment_frame_t *env, char **err_ptr);
+typedef data_t*(*primitive_function_with_context_impl)(void *context, data_t *args, environment_frame_t *env, char **err_ptr);
 
 typedef struct primitive_function_t {
   char *name;
   int number_of_parameters;
   bool special_form;
   primitive_function_impl impl;
+  primitive_function_with_context_impl context_impl;
+  void *context;
+  foreign_function_t *foreign;
 } primitive_function_t;
 
 
 void register_primitive(char *name, int parameter_count, primitive_function_impl impl);
 void register_special_form(char *name, int parameter_count, primitive_function_impl impl);
+data_t *invoke_primitive(primitive_function_t *prim, data_t *args, environment_frame_t *env, char **err_ptr);
 
 #endif
@@ -10,6 +10,9 @@
 #include <string.h>
 #include <strings.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
 #include "dictionary.h"
 #include "vector.h"
 #include "function.h"
@@ -17,6 +20,14 @@
 #include "primitives.h"
 #include "utils.h"
 #include "data.h"
+#include "environment_frame.h"
+#include "evaluator.h"
+#include "stats.h"
+#include "heap_profile.h"
+#include "heap_check.h"
+#include "heap_snapshot.h"
+#include "parallel.h"
+#include "interp.h"
 
 /********************************************************************************/
 /* math                                                                         */
@@ -285,6 +296,216 @@ data_t *unsigned_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 }
 
 
+/********************************************************************************/
+/* strings                                                                      */
+/********************************************************************************/
+
+data_t *string_length_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!stringp(car(args))) {
+    *err_ptr = strdup("string-length requires a string");
+    return NULL;
+  }
+  return integer_with_value(string_length(car(args)));
+}
+
+
+/* There is no character type, so characters are returned as their code. */
+
+data_t *string_ref_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *str = car(args);
+  data_t *index = car(cdr(args));
+  if (!stringp(str) || !integerp(index)) {
+    *err_ptr = strdup("string-ref requires a string and an integer index");
+    return NULL;
+  }
+  int k = integer_value(index);
+  if (k < 0 || k >= string_length(str)) {
+    *err_ptr = strdup("string-ref index out of bounds");
+    return NULL;
+  }
+  return integer_with_value((unsigned char)string_chars(str)[k]);
+}
+
+
+data_t *substring_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *str = car(args);
+  int arg_count = length_of(args);
+  if (arg_count < 2 || arg_count > 3) {
+    *err_ptr = strdup("substring requires a string, a start, and an optional end");
+    return NULL;
+  }
+  if (!stringp(str) || !integerp(car(cdr(args))) || (arg_count == 3 && !integerp(car(cdr(cdr(args)))))) {
+    *err_ptr = strdup("substring requires a string and integer indices");
+    return NULL;
+  }
+  int start = integer_value(car(cdr(args)));
+  int end = (arg_count == 3) ? integer_value(car(cdr(cdr(args)))) : string_length(str);
+  if (start < 0 || end > string_length(str) || start > end) {
+    *err_ptr = strdup("substring indices out of bounds");
+    return NULL;
+  }
+  return substring_of(str, start, end);
+}
+
+
+data_t *string_append_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  int length = 0;
+  for (data_t *cell = args; cell != NULL; cell = cdr(cell)) {
+    if (!stringp(car(cell))) {
+      *err_ptr = strdup("string-append requires string operands");
+      return NULL;
+    }
+    length += string_length(car(cell));
+  }
+  char *chars = (char*)malloc((length + 1) * sizeof(char));
+  int offset = 0;
+  for (data_t *cell = args; cell != NULL; cell = cdr(cell)) {
+    memcpy(chars + offset, string_chars(car(cell)), string_length(car(cell)));
+    offset += string_length(car(cell));
+  }
+  chars[length] = 0;
+  return string_with_length(chars, length);
+}
+
+
+data_t *string_equal_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!stringp(car(args)) || !stringp(car(cdr(args)))) {
+    *err_ptr = strdup("string=? requires string operands");
+    return NULL;
+  }
+  return boolean_with_value(is_equal(car(args), car(cdr(args))));
+}
+
+
+data_t *number_to_string_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!(integerp(car(args)) || unsigned_integerp(car(args)))) {
+    *err_ptr = strdup("number->string requires an (unsigned) integer operand");
+    return NULL;
+  }
+  return string_with_value(to_string(car(args)));
+}
+
+
+data_t *string_to_number_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *str = car(args);
+  if (!stringp(str)) {
+    *err_ptr = strdup("string->number requires a string operand");
+    return NULL;
+  }
+  char buf[16];
+  int length = string_length(str);
+  if (length == 0 || length >= (int)sizeof(buf)) {
+    return LISP_FALSE;
+  }
+  memcpy(buf, string_chars(str), length);
+  buf[length] = 0;
+  /* strtol and strtoul would skip leading space and take a sign, and clamp
+     or wrap what doesn't fit; a number here must start with its digits
+     and fit in 32 bits */
+  char *end;
+  errno = 0;
+  if (length > 2 && buf[0] == '#' && buf[1] == 'x') {
+    if (!isxdigit((unsigned char)buf[2])) {
+      return LISP_FALSE;
+    }
+    unsigned long value = strtoul(buf + 2, &end, 16);
+    if (*end != 0 || errno == ERANGE || value > UINT32_MAX) {
+      return LISP_FALSE;
+    }
+    return unsigned_integer_with_value((__uint32_t)value);
+  }
+  char *digits = (buf[0] == '-' || buf[0] == '+') ? buf + 1 : buf;
+  if (!isdigit((unsigned char)*digits)) {
+    return LISP_FALSE;
+  }
+  long value = strtol(buf, &end, 10);
+  if (*end != 0 || errno == ERANGE || value < INT32_MIN || value > INT32_MAX) {
+    return LISP_FALSE;
+  }
+  return integer_with_value((int)value);
+}
+
+
+data_t *make_string_builder_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (args != NULL && !integerp(car(args))) {
+    *err_ptr = strdup("make-string-builder takes an optional integer capacity");
+    return NULL;
+  }
+  return string_builder_with_capacity(args == NULL ? 0 : integer_value(car(args)));
+}
+
+
+data_t *string_builder_append_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *builder = car(args);
+  if (!string_builderp(builder)) {
+    *err_ptr = strdup("string-builder-append! requires a string builder");
+    return NULL;
+  }
+  for (data_t *cell = cdr(args); cell != NULL; cell = cdr(cell)) {
+    data_t *item = car(cell);
+    if (stringp(item)) {
+      string_builder_append(builder, string_chars(item), string_length(item));
+    } else if (symbolp(item)) {
+      string_builder_append(builder, string_value(item), strlen(string_value(item)));
+    } else if (integerp(item)) {
+      char buf[12];
+      int length = sprintf(buf, "%d", integer_value(item));
+      string_builder_append(builder, buf, length);
+    } else {
+      char *str = to_string(item);
+      string_builder_append(builder, str, strlen(str));
+      free(str);
+    }
+  }
+  return builder;
+}
+
+
+data_t *string_builder_to_string_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  string_builder_t *b = string_builder_value(car(args));
+  if (b == NULL) {
+    *err_ptr = strdup("string-builder->string requires a string builder");
+    return NULL;
+  }
+  char *chars = (char*)malloc((b->length + 1) * sizeof(char));
+  memcpy(chars, b->chars, b->length);
+  chars[b->length] = 0;
+  return string_with_length(chars, b->length);
+}
+
+
+data_t *string_builder_length_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  string_builder_t *b = string_builder_value(car(args));
+  if (b == NULL) {
+    *err_ptr = strdup("string-builder-length requires a string builder");
+    return NULL;
+  }
+  return integer_with_value(b->length);
+}
+
+
 /********************************************************************************/
 /* list                                                                         */
 /********************************************************************************/
@@ -698,7 +919,7 @@ data_t *appendbang_impl(data_t *args, environment_frame_t *env, char **err_ptr)
           for (l = last_list; l != NULL && cdr(l) != NULL; l = cdr(l))
             ;
           last_list = car(arglist);
-          set_cdr(l, last_list);
+          set_cdr(l, retain(last_list));
         }
         arglist = cdr(arglist);
       }
@@ -709,182 +930,1349 @@ data_t *appendbang_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 }
 
 
-/********************************************************************************/
-/* relative                                                                     */
-/********************************************************************************/
+bool is_eqv(data_t *d, data_t *o)
+{
+  if (d == o) {
+    return true;
+  }
+  if ((integerp(d) && integerp(o)) || (unsigned_integerp(d) && unsigned_integerp(o))) {
+    return d->data.uint_data == o->data.uint_data;
+  }
+  return false;
+}
 
 
-char *check_relative_args(data_t *args)
+data_t *find_association(data_t *key, data_t *alist, bool (*same)(data_t*, data_t*), char **err_ptr)
 {
-  if (length_of(args) != 2) {
-    return "Relative predicates require exactly 2 arguments.";
+  *err_ptr = NULL;
+  if (!listp(alist)) {
+    *err_ptr = strdup("Association lookup requires a list");
+    return NULL;
   }
-  if (!(integerp(car(args)) || unsigned_integerp(car(args))) || !(integerp(car(cdr(args))) || unsigned_integerp(car(cdr(args))))) {
-    return "Relative predicates require numeric arguments";
+  for (data_t *cell = alist; cell != NULL; cell = cdr(cell)) {
+    data_t *pair = car(cell);
+    if (listp(pair) && pair != NULL && same(key, car(pair))) {
+      return pair;
+    }
   }
-  return NULL;
+  return LISP_FALSE;
 }
 
 
-data_t *eq_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *find_member(data_t *item, data_t *l, bool (*same)(data_t*, data_t*), char **err_ptr)
 {
-  if (length_of(args) != 2) {
-    *err_ptr = strdup("Relative functions require exactly 2 arguments.");
+  *err_ptr = NULL;
+  if (!listp(l)) {
+    *err_ptr = strdup("Membership test requires a list");
     return NULL;
   }
+  for (data_t *cell = l; cell != NULL; cell = cdr(cell)) {
+    if (same(item, car(cell))) {
+      return cell;
+    }
+  }
+  return LISP_FALSE;
+}
 
-  return boolean_with_value(is_equal(car(args), car(cdr(args))));
+
+data_t *assq_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return find_association(car(args), car(cdr(args)), &is_eqv, err_ptr);
 }
 
 
-data_t *neq_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *assoc_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 {
-  return boolean_with_value(!is_equal(car(args), car(cdr(args))));
+  return find_association(car(args), car(cdr(args)), &is_equal, err_ptr);
 }
 
 
-data_t *lt_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *memq_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 {
-  *err_ptr = check_relative_args(args);
-  if (*err_ptr != NULL) {
-    return NULL;
-  }
-  bool result;
-  if (integerp(car(args)) || integerp(car(cdr(args)))) {
-    result = integer_value(car(args)) < integer_value(car(cdr(args)));
-  } else {
-    result = unsigned_integer_value(car(args)) < unsigned_integer_value(car(cdr(args)));
-  }
-  return boolean_with_value(result);
+  return find_member(car(args), car(cdr(args)), &is_eqv, err_ptr);
 }
 
 
-data_t *lte_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *member_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 {
-  *err_ptr = check_relative_args(args);
-  if (*err_ptr != NULL) {
-    return NULL;
-  }
-  bool result;
-  if (integerp(car(args)) || integerp(car(cdr(args)))) {
-    result = integer_value(car(args)) <= integer_value(car(cdr(args)));
-  } else {
-    result = unsigned_integer_value(car(args)) <= unsigned_integer_value(car(cdr(args)));
-  }
-  return boolean_with_value(result);
+  return find_member(car(args), car(cdr(args)), &is_equal, err_ptr);
 }
 
 
-data_t *gte_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+/********************************************************************************/
+/* higher order                                                                 */
+/********************************************************************************/
+
+/* These call closures through apply_to_values, which binds already evaluated
+   arguments into a single frame that is reused across iterations. The
+   argument list handed to the callee is a fixed set of cells whose cars are
+   overwritten on each iteration, so no consing happens per element. */
+
+
+data_t *make_argument_cells(int count)
 {
-  *err_ptr = check_relative_args(args);
-  if (*err_ptr != NULL) {
-    return NULL;
+  data_t *cells = NULL;
+  for (int i = 0; i < count; i++) {
+    data_t *cell = empty_cons();
+    set_cdr(cell, cells);
+    cells = cell;
   }
-  bool result;
-  if (integerp(car(args)) || integerp(car(cdr(args)))) {
-    result = integer_value(car(args)) >= integer_value(car(cdr(args)));
-  } else {
-    result = unsigned_integer_value(car(args)) >= unsigned_integer_value(car(cdr(args)));
-  }
-  return boolean_with_value(result);
+  return cells;
 }
 
 
-data_t *gt_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+void free_argument_cells(data_t *cells)
 {
-  *err_ptr = check_relative_args(args);
-  if (*err_ptr != NULL) {
-    return NULL;
-  }
-  bool result;
-  if (integerp(car(args)) || integerp(car(cdr(args)))) {
-    result = integer_value(car(args)) > integer_value(car(cdr(args)));
-  } else {
-    result = unsigned_integer_value(car(args)) > unsigned_integer_value(car(cdr(args)));
+  while (cells != NULL) {
+    data_t *next = cdr(cells);
+    set_car(cells, NULL);
+    set_cdr(cells, NULL);
+    free_data(cells);
+    cells = next;
   }
-  return boolean_with_value(result);
 }
 
 
-data_t *nil_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+bool check_callable(data_t *f, char *name, char **err_ptr)
 {
-  data_t *thing = car(args);
-  return boolean_with_value(thing == NULL || (listp(thing) && length_of(thing) == 0));
+  if (type_of(f) != FUNCTION_TYPE && type_of(f) != PRIMITIVE_TYPE) {
+    char *buf = (char*)malloc((48 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s requires a function as it's first argument", name);
+    *err_ptr = buf;
+    return false;
+  }
+  return true;
 }
 
 
-data_t *listp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+/* Loads the next element of each list into the argument cells and advances
+   the lists. Returns false when any list is exhausted. */
+
+bool load_next_arguments(Vector *lists, data_t *argument_cells)
 {
-  return boolean_with_value(listp(car(args)));
+  data_t *argument_cell = argument_cells;
+  for (int i = 0; i < lists->size; i++) {
+    data_t *l = lists->data[i];
+    if (l == NULL) {
+      return false;
+    }
+    set_car(argument_cell, car(l));
+    lists->data[i] = cdr(l);
+    argument_cell = cdr(argument_cell);
+  }
+  return true;
 }
 
 
-data_t *symbolp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *map_over_lists(data_t *args, environment_frame_t *env, bool collect, char *name, char **err_ptr)
 {
-  return boolean_with_value(symbolp(car(args)));
+  *err_ptr = NULL;
+  data_t *f = car(args);
+  if (!check_callable(f, name, err_ptr)) {
+    return NULL;
+  }
+  if (cdr(args) == NULL) {
+    *err_ptr = strdup("map/for-each requires at least one list");
+    return NULL;
+  }
+
+  Vector lists;
+  vector_init(&lists);
+  for (data_t *cell = cdr(args); cell != NULL; cell = cdr(cell)) {
+    if (!listp(car(cell))) {
+      vector_free(&lists);
+      *err_ptr = strdup("map/for-each requires list arguments");
+      return NULL;
+    }
+    vector_append(&lists, car(cell));
+  }
+
+  Vector results;
+  vector_init(&results);
+  data_t *argument_cells = make_argument_cells(lists.size);
+  environment_frame_t *frame = NULL;
+  while (load_next_arguments(&lists, argument_cells)) {
+    data_t *value = apply_to_values(f, argument_cells, env, &frame, err_ptr);
+    if (*err_ptr != NULL) {
+      break;
+    }
+    retain(value);
+    if (collect) {
+      vector_append(&results, value);
+    } else {
+      release(value);
+    }
+  }
+  free_argument_cells(argument_cells);
+  release_call_frame(frame);
+  vector_free(&lists);
+
+  data_t *result = NULL;
+  if (collect && *err_ptr == NULL) {
+    result = vector_to_list(&results);
+  }
+  for (int i = 0; i < results.size; i++) {
+    release(results.data[i]);
+  }
+  vector_free(&results);
+  return result;
 }
 
 
-data_t *stringp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *map_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 {
-  return boolean_with_value(stringp(car(args)));
+  return map_over_lists(args, env, true, "map", err_ptr);
 }
 
 
-data_t *integerp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *for_each_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 {
-  return boolean_with_value(integerp(car(args)));
+  return map_over_lists(args, env, false, "for-each", err_ptr);
 }
 
 
-data_t *unsignedp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+/* Maps over one list on a pool of isolates, or in place when there aren't
+   enough items, cores or threads to bother */
+
+data_t *parallel_map_over_list(data_t *args, environment_frame_t *env, bool collect, char *name, char **err_ptr)
 {
-  return boolean_with_value(unsigned_integerp(car(args)));
+  *err_ptr = NULL;
+  if (!check_callable(car(args), name, err_ptr)) {
+    return NULL;
+  }
+  if (cdr(args) == NULL || !listp(car(cdr(args)))) {
+    char *buf = (char*)malloc((32 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s requires a list", name);
+    *err_ptr = buf;
+    return NULL;
+  }
+  if (parallel_workers_for(length_of(car(cdr(args)))) < 2) {
+    return map_over_lists(args, env, collect, name, err_ptr);
+  }
+  return parallel_map(car(args), car(cdr(args)), collect, err_ptr);
 }
 
 
-data_t *functionp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *pmap_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 {
-  return boolean_with_value(functionp(car(args)));
+  return parallel_map_over_list(args, env, true, "pmap", err_ptr);
 }
 
 
-data_t *macrop_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *pfor_each_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 {
-  return boolean_with_value(macrop(car(args)));
+  return parallel_map_over_list(args, env, false, "pfor-each", err_ptr);
 }
 
 
-data_t *definition_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+data_t *filter_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 {
-  data_t *thing = car(args);
-
-  if (functionp(thing)) {
-    return string_with_value(to_string(func_value(thing)->body));
-  } else if (macrop(thing)) {
-    return string_with_value(to_string(macro_value(thing)->body));
-  } else {
-    *err_ptr = strdup("definiton requires a function or macro.");
+  *err_ptr = NULL;
+  data_t *f = car(args);
+  data_t *l = car(cdr(args));
+  if (!check_callable(f, "filter", err_ptr)) {
+    return NULL;
+  }
+  if (!listp(l)) {
+    *err_ptr = strdup("filter requires a list as it's second argument");
+    return NULL;
   }
-  return NULL;
-}
 
+  Vector kept;
+  vector_init(&kept);
+  data_t *argument_cells = make_argument_cells(1);
+  environment_frame_t *frame = NULL;
+  for (data_t *cell = l; cell != NULL; cell = cdr(cell)) {
+    set_car(argument_cells, car(cell));
+    data_t *value = apply_to_values(f, argument_cells, env, &frame, err_ptr);
+    if (*err_ptr != NULL) {
+      break;
+    }
+    if (boolean_value(value)) {
+      vector_append(&kept, car(cell));
+    }
+    retain(value);
+    release(value);
+  }
+  free_argument_cells(argument_cells);
+  release_call_frame(frame);
 
-data_t *heap_size_impl(data_t *args, environment_frame_t *env, char **err_ptr)
-{
-  return integer_with_value(total_cells());
+  data_t *result = NULL;
+  if (*err_ptr == NULL) {
+    result = vector_to_list(&kept);
+  }
+  vector_free(&kept);
+  return result;
 }
 
 
-data_t *free_size_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+/* Folds f over l, calling (f element accumulator). The accumulator is kept
+   retained between calls and handed back unreferenced. */
+
+data_t *fold_list(data_t *f, data_t *initial, data_t *l, environment_frame_t *env, char **err_ptr)
 {
-  return integer_with_value(cells_remaining());
+  data_t *acc = retain(initial);
+  data_t *argument_cells = make_argument_cells(2);
+  environment_frame_t *frame = NULL;
+  for (data_t *cell = l; cell != NULL; cell = cdr(cell)) {
+    set_car(argument_cells, car(cell));
+    set_car(cdr(argument_cells), acc);
+    data_t *value = apply_to_values(f, argument_cells, env, &frame, err_ptr);
+    if (*err_ptr != NULL) {
+      break;
+    }
+    retain(value);
+    release(acc);
+    acc = value;
+  }
+  free_argument_cells(argument_cells);
+  release_call_frame(frame);
+  if (*err_ptr != NULL) {
+    release(acc);
+    return NULL;
+  }
+  return disown(acc);
 }
 
 
-/* data_t *gc_impl(data_t *args, environment_frame_t *env, char **err_ptr) */
-/* { */
+data_t *fold_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *f = car(args);
+  data_t *l = car(cdr(cdr(args)));
+  if (!check_callable(f, "fold", err_ptr)) {
+    return NULL;
+  }
+  if (!listp(l)) {
+    *err_ptr = strdup("fold requires a list as it's third argument");
+    return NULL;
+  }
+  return fold_list(f, car(cdr(args)), l, env, err_ptr);
+}
+
+
+data_t *reduce_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *f = car(args);
+  data_t *l = car(cdr(cdr(args)));
+  if (!check_callable(f, "reduce", err_ptr)) {
+    return NULL;
+  }
+  if (!listp(l)) {
+    *err_ptr = strdup("reduce requires a list as it's third argument");
+    return NULL;
+  }
+  if (l == NULL) {
+    return car(cdr(args));
+  }
+  return fold_list(f, car(l), cdr(l), env, err_ptr);
+}
+
+
+data_t *apply_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *f = car(args);
+  if (!check_callable(f, "apply", err_ptr)) {
+    return NULL;
+  }
+  if (cdr(args) == NULL) {
+    *err_ptr = strdup("apply requires a list of arguments");
+    return NULL;
+  }
+
+  Vector spread;
+  vector_init(&spread);
+  data_t *cell;
+  for (cell = cdr(args); cdr(cell) != NULL; cell = cdr(cell)) {
+    vector_append(&spread, car(cell));
+  }
+  if (!listp(car(cell))) {
+    vector_free(&spread);
+    *err_ptr = strdup("apply requires a list as it's last argument");
+    return NULL;
+  }
+  data_t *arguments = (spread.size == 0) ? car(cell) : vector_to_list_with_tail(&spread, car(cell));
+  vector_free(&spread);
+
+  environment_frame_t *frame = NULL;
+  data_t *result = retain(apply_to_values(f, arguments, env, &frame, err_ptr));
+  release_call_frame(frame);
+  if (arguments != car(cell)) {
+    release(arguments);
+  }
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  return disown(result);
+}
+
+
+/********************************************************************************/
+/* persistent maps                                                              */
+/********************************************************************************/
+
+/* Maps are immutable: every update returns a new map that shares all but
+   the changed path with the original. */
+
+data_t *map_with_pairs(hamt_node_t *root, int count, data_t *pairs, char *name, char **err_ptr)
+{
+  if (length_of(pairs) % 2 != 0) {
+    hamt_release(root);
+    char *buf = (char*)malloc((48 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s requires keys and values in pairs", name);
+    *err_ptr = buf;
+    return NULL;
+  }
+  for (data_t *cell = pairs; cell != NULL; cell = cdr(cdr(cell))) {
+    bool added;
+    hamt_node_t *updated = hamt_assoc(root, car(cell), car(cdr(cell)), &added);
+    hamt_release(root);
+    root = updated;
+    if (added) {
+      count++;
+    }
+  }
+  return hash_map_with_root(root, count);
+}
+
+
+bool check_hash_map(data_t *m, char *name, char **err_ptr)
+{
+  if (!hash_mapp(m)) {
+    char *buf = (char*)malloc((48 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s requires a hash map as it's first argument", name);
+    *err_ptr = buf;
+    return false;
+  }
+  return true;
+}
+
+
+hamt_node_t *shared_root(data_t *m)
+{
+  hamt_node_t *root = hash_map_root(m);
+  if (root != NULL) {
+    root->refs++;
+  }
+  return root;
+}
+
+
+data_t *hash_map_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  return map_with_pairs(NULL, 0, args, "hash-map", err_ptr);
+}
+
+
+data_t *hash_mapp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  return boolean_with_value(hash_mapp(car(args)));
+}
+
+
+data_t *hash_map_ref_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  int arg_count = length_of(args);
+  if (arg_count < 2 || arg_count > 3) {
+    *err_ptr = strdup("hash-map-ref requires a map, a key, and an optional default");
+    return NULL;
+  }
+  if (!check_hash_map(car(args), "hash-map-ref", err_ptr)) {
+    return NULL;
+  }
+  bool found;
+  data_t *value = hamt_get(hash_map_root(car(args)), car(cdr(args)), &found);
+  if (found) {
+    return value;
+  }
+  return (arg_count == 3) ? car(cdr(cdr(args))) : LISP_FALSE;
+}
+
+
+data_t *hash_map_contains_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_hash_map(car(args), "hash-map-contains?", err_ptr)) {
+    return NULL;
+  }
+  bool found;
+  hamt_get(hash_map_root(car(args)), car(cdr(args)), &found);
+  return boolean_with_value(found);
+}
+
+
+data_t *hash_map_assoc_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *m = car(args);
+  if (!check_hash_map(m, "hash-map-assoc", err_ptr)) {
+    return NULL;
+  }
+  return map_with_pairs(shared_root(m), hash_map_count(m), cdr(args), "hash-map-assoc", err_ptr);
+}
+
+
+data_t *hash_map_dissoc_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *m = car(args);
+  if (!check_hash_map(m, "hash-map-dissoc", err_ptr)) {
+    return NULL;
+  }
+  hamt_node_t *root = shared_root(m);
+  int count = hash_map_count(m);
+  for (data_t *cell = cdr(args); cell != NULL; cell = cdr(cell)) {
+    bool removed;
+    hamt_node_t *updated = hamt_dissoc(root, car(cell), &removed);
+    hamt_release(root);
+    root = updated;
+    if (removed) {
+      count--;
+    }
+  }
+  return hash_map_with_root(root, count);
+}
+
+
+/* (hash-map-update map key f [default]) binds key to (f old-value), using
+   default (or #f) as the old value when key is absent */
+
+data_t *hash_map_update_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  int arg_count = length_of(args);
+  if (arg_count < 3 || arg_count > 4) {
+    *err_ptr = strdup("hash-map-update requires a map, a key, a function, and an optional default");
+    return NULL;
+  }
+  data_t *m = car(args);
+  data_t *key = car(cdr(args));
+  data_t *f = car(cdr(cdr(args)));
+  if (!check_hash_map(m, "hash-map-update", err_ptr) || !check_callable(f, "hash-map-update", err_ptr)) {
+    return NULL;
+  }
+  bool found;
+  data_t *old_value = hamt_get(hash_map_root(m), key, &found);
+  if (!found) {
+    old_value = (arg_count == 4) ? car(cdr(cdr(cdr(args)))) : LISP_FALSE;
+  }
+
+  data_t *argument_cells = make_argument_cells(1);
+  set_car(argument_cells, old_value);
+  environment_frame_t *frame = NULL;
+  data_t *new_value = retain(apply_to_values(f, argument_cells, env, &frame, err_ptr));
+  release_call_frame(frame);
+  free_argument_cells(argument_cells);
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+
+  bool added;
+  hamt_node_t *root = hamt_assoc(hash_map_root(m), key, new_value, &added);
+  release(new_value);
+  return hash_map_with_root(root, hash_map_count(m) + (added ? 1 : 0));
+}
+
+
+data_t *hash_map_count_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_hash_map(car(args), "hash-map-count", err_ptr)) {
+    return NULL;
+  }
+  return integer_with_value(hash_map_count(car(args)));
+}
+
+
+void collect_key(data_t *key, data_t *value, void *context)
+{
+  vector_append((Vector*)context, key);
+}
+
+
+void collect_pair(data_t *key, data_t *value, void *context)
+{
+  vector_append((Vector*)context, internal_make_list(2, key, value));
+}
+
+
+data_t *hash_map_keys_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_hash_map(car(args), "hash-map-keys", err_ptr)) {
+    return NULL;
+  }
+  Vector keys;
+  vector_init(&keys);
+  hamt_for_each(hash_map_root(car(args)), &collect_key, &keys);
+  data_t *result = vector_to_list(&keys);
+  vector_free(&keys);
+  return result;
+}
+
+
+data_t *hash_map_to_list_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_hash_map(car(args), "hash-map->list", err_ptr)) {
+    return NULL;
+  }
+  Vector pairs;
+  vector_init(&pairs);
+  hamt_for_each(hash_map_root(car(args)), &collect_pair, &pairs);
+  data_t *result = vector_to_list(&pairs);
+  vector_free(&pairs);
+  return result;
+}
+
+
+/********************************************************************************/
+/* persistent vectors                                                           */
+/********************************************************************************/
+
+bool check_vector(data_t *v, char *name, char **err_ptr)
+{
+  if (!pvectorp(v)) {
+    char *buf = (char*)malloc((48 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s requires a vector as it's first argument", name);
+    *err_ptr = buf;
+    return false;
+  }
+  return true;
+}
+
+
+bool check_vector_index(data_t *v, data_t *index, char *name, char **err_ptr)
+{
+  if (!check_vector(v, name, err_ptr)) {
+    return false;
+  }
+  if (!integerp(index) || integer_value(index) < 0 || integer_value(index) >= pvector_value(v)->count) {
+    char *buf = (char*)malloc((48 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s index out of bounds", name);
+    *err_ptr = buf;
+    return false;
+  }
+  return true;
+}
+
+
+pvector_t *pvector_from_list(data_t *l)
+{
+  pvector_t *v = pvector_empty();
+  for (data_t *cell = l; cell != NULL; cell = cdr(cell)) {
+    pvector_t *pushed = pvector_push(v, car(cell));
+    pvector_release(v);
+    v = pushed;
+  }
+  return v;
+}
+
+
+data_t *pvector_to_list(pvector_t *v)
+{
+  Vector items;
+  vector_init(&items);
+  for (int i = 0; i < v->count; i++) {
+    vector_append(&items, pvector_ref(v, i));
+  }
+  data_t *result = vector_to_list(&items);
+  vector_free(&items);
+  return result;
+}
+
+
+data_t *vector_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  return pvector_with_value(pvector_from_list(args));
+}
+
+
+data_t *vectorp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  return boolean_with_value(pvectorp(car(args)));
+}
+
+
+data_t *vector_length_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_vector(car(args), "vector-length", err_ptr)) {
+    return NULL;
+  }
+  return integer_with_value(pvector_value(car(args))->count);
+}
+
+
+data_t *vector_ref_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_vector_index(car(args), car(cdr(args)), "vector-ref", err_ptr)) {
+    return NULL;
+  }
+  return pvector_ref(pvector_value(car(args)), integer_value(car(cdr(args))));
+}
+
+
+data_t *vector_set_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_vector_index(car(args), car(cdr(args)), "vector-set", err_ptr)) {
+    return NULL;
+  }
+  return pvector_with_value(pvector_set(pvector_value(car(args)), integer_value(car(cdr(args))), car(cdr(cdr(args)))));
+}
+
+
+data_t *vector_update_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  data_t *f = car(cdr(cdr(args)));
+  if (!check_vector_index(car(args), car(cdr(args)), "vector-update", err_ptr) || !check_callable(f, "vector-update", err_ptr)) {
+    return NULL;
+  }
+  pvector_t *v = pvector_value(car(args));
+  int index = integer_value(car(cdr(args)));
+
+  data_t *argument_cells = make_argument_cells(1);
+  set_car(argument_cells, pvector_ref(v, index));
+  environment_frame_t *frame = NULL;
+  data_t *new_value = retain(apply_to_values(f, argument_cells, env, &frame, err_ptr));
+  release_call_frame(frame);
+  free_argument_cells(argument_cells);
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  data_t *result = pvector_with_value(pvector_set(v, index, new_value));
+  release(new_value);
+  return result;
+}
+
+
+data_t *vector_push_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_vector(car(args), "vector-push", err_ptr)) {
+    return NULL;
+  }
+  return pvector_with_value(pvector_push(pvector_value(car(args)), car(cdr(args))));
+}
+
+
+data_t *vector_pop_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_vector(car(args), "vector-pop", err_ptr)) {
+    return NULL;
+  }
+  if (pvector_value(car(args))->count == 0) {
+    *err_ptr = strdup("vector-pop requires a non-empty vector");
+    return NULL;
+  }
+  return pvector_with_value(pvector_pop(pvector_value(car(args))));
+}
+
+
+/* Relaxed (RRB) concatenation is not implemented, so appending pushes the
+   elements of each following vector onto the first. */
+
+data_t *vector_append_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  for (data_t *cell = args; cell != NULL; cell = cdr(cell)) {
+    if (!check_vector(car(cell), "vector-append", err_ptr)) {
+      return NULL;
+    }
+  }
+  if (args == NULL) {
+    return pvector_with_value(pvector_empty());
+  }
+  pvector_t *first = pvector_value(car(args));
+  pvector_t *v = NULL;
+  for (data_t *cell = cdr(args); cell != NULL; cell = cdr(cell)) {
+    pvector_t *w = pvector_value(car(cell));
+    for (int i = 0; i < w->count; i++) {
+      pvector_t *pushed = pvector_push(v == NULL ? first : v, pvector_ref(w, i));
+      if (v != NULL) {
+        pvector_release(v);
+      }
+      v = pushed;
+    }
+  }
+  if (v == NULL) {
+    return car(args);
+  }
+  return pvector_with_value(v);
+}
+
+
+data_t *vector_to_list_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_vector(car(args), "vector->list", err_ptr)) {
+    return NULL;
+  }
+  return pvector_to_list(pvector_value(car(args)));
+}
+
+
+data_t *list_to_vector_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!listp(car(args))) {
+    *err_ptr = strdup("list->vector requires a list");
+    return NULL;
+  }
+  return pvector_with_value(pvector_from_list(car(args)));
+}
+
+
+/********************************************************************************/
+/* relative                                                                     */
+/********************************************************************************/
+
+
+char *check_relative_args(data_t *args)
+{
+  if (length_of(args) != 2) {
+    return strdup("Relative predicates require exactly 2 arguments.");
+  }
+  if (!(integerp(car(args)) || unsigned_integerp(car(args))) || !(integerp(car(cdr(args))) || unsigned_integerp(car(cdr(args))))) {
+    return strdup("Relative predicates require numeric arguments");
+  }
+  return NULL;
+}
+
+
+data_t *eq_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  if (length_of(args) != 2) {
+    *err_ptr = strdup("Relative functions require exactly 2 arguments.");
+    return NULL;
+  }
+
+  return boolean_with_value(is_equal(car(args), car(cdr(args))));
+}
+
+
+data_t *neq_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(!is_equal(car(args), car(cdr(args))));
+}
+
+
+data_t *lt_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = check_relative_args(args);
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  bool result;
+  if (integerp(car(args)) || integerp(car(cdr(args)))) {
+    result = integer_value(car(args)) < integer_value(car(cdr(args)));
+  } else {
+    result = unsigned_integer_value(car(args)) < unsigned_integer_value(car(cdr(args)));
+  }
+  return boolean_with_value(result);
+}
+
+
+data_t *lte_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = check_relative_args(args);
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  bool result;
+  if (integerp(car(args)) || integerp(car(cdr(args)))) {
+    result = integer_value(car(args)) <= integer_value(car(cdr(args)));
+  } else {
+    result = unsigned_integer_value(car(args)) <= unsigned_integer_value(car(cdr(args)));
+  }
+  return boolean_with_value(result);
+}
+
+
+data_t *gte_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = check_relative_args(args);
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  bool result;
+  if (integerp(car(args)) || integerp(car(cdr(args)))) {
+    result = integer_value(car(args)) >= integer_value(car(cdr(args)));
+  } else {
+    result = unsigned_integer_value(car(args)) >= unsigned_integer_value(car(cdr(args)));
+  }
+  return boolean_with_value(result);
+}
+
+
+data_t *gt_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = check_relative_args(args);
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  bool result;
+  if (integerp(car(args)) || integerp(car(cdr(args)))) {
+    result = integer_value(car(args)) > integer_value(car(cdr(args)));
+  } else {
+    result = unsigned_integer_value(car(args)) > unsigned_integer_value(car(cdr(args)));
+  }
+  return boolean_with_value(result);
+}
+
+
+data_t *nil_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  data_t *thing = car(args);
+  return boolean_with_value(thing == NULL || (listp(thing) && length_of(thing) == 0));
+}
+
+
+data_t *listp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(listp(car(args)));
+}
+
+
+data_t *symbolp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(symbolp(car(args)));
+}
+
+
+data_t *stringp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(stringp(car(args)));
+}
+
+
+data_t *integerp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(integerp(car(args)));
+}
+
+
+data_t *unsignedp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(unsigned_integerp(car(args)));
+}
+
+
+data_t *functionp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(functionp(car(args)));
+}
+
+
+data_t *macrop_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(macrop(car(args)));
+}
+
+
+data_t *recordp_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(recordp(car(args)));
+}
+
+
+data_t *definition_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  data_t *thing = car(args);
+
+  if (functionp(thing)) {
+    return string_with_value(to_string(func_value(thing)->body));
+  } else if (macrop(thing)) {
+    return string_with_value(to_string(macro_value(thing)->body));
+  } else {
+    *err_ptr = strdup("definiton requires a function or macro.");
+  }
+  return NULL;
+}
+
+
+data_t *heap_size_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return integer_with_value(total_cells());
+}
+
+
+data_t *free_size_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return integer_with_value(cells_remaining());
+}
+
+
+/* Integers are 32 bits, so a counter past INT32_MAX reads as INT32_MAX
+   rather than wrapping negative; reset the counters between samples to
+   keep measuring. */
+
+data_t *stat_entry(char *name, uint64_t value)
+{
+  return cons(intern_symbol(name), integer_with_value((value > INT32_MAX) ? INT32_MAX : (int)value));
+}
+
+
+/* Returns the runtime counters as an association list. Allocation counts
+   are broken down by cell type, leaving out types never allocated. */
+
+data_t *runtime_stats_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  Vector by_type;
+  vector_init(&by_type);
+  for (int type = CONS_CELL_TYPE; type < STATS_CELL_TYPES; type++) {
+    if (current_interp->stats.cells_allocated[type] > 0) {
+      vector_append(&by_type, stat_entry(type_name(type), current_interp->stats.cells_allocated[type]));
+    }
+  }
+  data_t *cells_by_type = vector_to_list(&by_type);
+  vector_free(&by_type);
+
+  return internal_make_list(15,
+                            stat_entry("evaluations", current_interp->stats.evaluations),
+                            stat_entry("primitive-applications", current_interp->stats.primitive_applications),
+                            stat_entry("function-applications", current_interp->stats.function_applications),
+                            stat_entry("macro-applications", current_interp->stats.macro_applications),
+                            stat_entry("macro-expansions", current_interp->stats.macro_expansions),
+                            stat_entry("frames-created", current_interp->stats.frames_created),
+                            stat_entry("frames-freed", current_interp->stats.frames_freed),
+                            stat_entry("dictionary-lookups", current_interp->stats.dictionary_lookups),
+                            stat_entry("dictionary-chain-steps", current_interp->stats.dictionary_chain_steps),
+                            stat_entry("cells-allocated", total_cells_allocated()),
+                            cons(intern_symbol("cells-allocated-by-type"), cells_by_type),
+                            stat_entry("retains", current_interp->stats.retains),
+                            stat_entry("releases", current_interp->stats.releases),
+                            stat_entry("peak-stack-depth", current_interp->stats.peak_stack_depth),
+                            stat_entry("cells-in-use", cells_allocated()));
+}
+
+
+data_t *reset_runtime_stats_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  reset_runtime_stats();
+  return NULL;
+}
+
+
+/* Validates the free list and reference counts, printing any problems */
+
+data_t *heap_check_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  return boolean_with_value(check_heap(stdout) == 0);
+}
+
+
+/* Writes the heap graph to a file for tools/decode_snapshot.c, returning
+   the number of cells and frames written */
+
+data_t *heap_snapshot_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  data_t *filename = car(args);
+  if (!stringp(filename)) {
+    *err_ptr = strdup("heap-snapshot requires a file name");
+    return NULL;
+  }
+  int nodes = write_heap_snapshot(string_value(filename), err_ptr);
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  return integer_with_value(nodes);
+}
+
+
+/* Prints live and total cells per allocation site and type */
+
+data_t *heap_profile_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  if (!heap_profiling) {
+    *err_ptr = strdup("heap-profile requires allocation profiling, which is turned on with -A");
+    return NULL;
+  }
+  heap_profile_report(stdout);
+  return NULL;
+}
+
+
+/********************************************************************************/
+/* sorting                                                                      */
+/********************************************************************************/
+
+/* Sorting is a stable merge sort. Lists are sorted by relinking their cells,
+   vectors through a scratch array. When the comparator is the < or >
+   primitive and both values are integers they are compared directly rather
+   than by calling the comparator. */
+
+typedef struct sort_context_t {
+  data_t *f;
+  int direction;
+  environment_frame_t *env;
+  environment_frame_t *frame;
+  data_t *argument_cells;
+  char **err_ptr;
+} sort_context_t;
+
+
+void init_sort_context(sort_context_t *context, data_t *f, environment_frame_t *env, char **err_ptr)
+{
+  context->f = f;
+  context->direction = 0;
+  if (type_of(f) == PRIMITIVE_TYPE && prim_value(f)->impl == &lt_impl) {
+    context->direction = 1;
+  } else if (type_of(f) == PRIMITIVE_TYPE && prim_value(f)->impl == &gt_impl) {
+    context->direction = -1;
+  }
+  context->env = env;
+  context->frame = NULL;
+  context->argument_cells = make_argument_cells(2);
+  context->err_ptr = err_ptr;
+}
+
+
+void free_sort_context(sort_context_t *context)
+{
+  free_argument_cells(context->argument_cells);
+  release_call_frame(context->frame);
+}
+
+
+/* Whether a belongs strictly before b. Once the comparator has failed
+   everything compares equal so the sort finishes without reordering. */
+
+bool sort_before(sort_context_t *context, data_t *a, data_t *b)
+{
+  if (*context->err_ptr != NULL) {
+    return false;
+  }
+  if (context->direction != 0 && integerp(a) && integerp(b)) {
+    if (context->direction > 0) {
+      return integer_value(a) < integer_value(b);
+    } else {
+      return integer_value(a) > integer_value(b);
+    }
+  }
+  set_car(context->argument_cells, a);
+  set_car(cdr(context->argument_cells), b);
+  data_t *value = apply_to_values(context->f, context->argument_cells, context->env, &context->frame, context->err_ptr);
+  if (*context->err_ptr != NULL) {
+    return false;
+  }
+  bool result = boolean_value(value);
+  retain(value);
+  release(value);
+  return result;
+}
+
+
+data_t *merge_cells(data_t *left, data_t *right, sort_context_t *context)
+{
+  data_t *head = NULL;
+  data_t *tail = NULL;
+  while (left != NULL && right != NULL) {
+    data_t *next;
+    if (sort_before(context, car(right), car(left))) {
+      next = right;
+      right = cdr(right);
+    } else {
+      next = left;
+      left = cdr(left);
+    }
+    if (tail == NULL) {
+      head = next;
+    } else {
+      set_cdr(tail, next);
+    }
+    tail = next;
+  }
+  data_t *rest = (left != NULL) ? left : right;
+  if (tail == NULL) {
+    return rest;
+  }
+  set_cdr(tail, rest);
+  return head;
+}
+
+
+data_t *merge_sort_cells(data_t *l, int length, sort_context_t *context)
+{
+  if (length < 2) {
+    return l;
+  }
+  int half = length / 2;
+  data_t *last_of_left = l;
+  for (int i = 1; i < half; i++) {
+    last_of_left = cdr(last_of_left);
+  }
+  data_t *right = cdr(last_of_left);
+  set_cdr(last_of_left, NULL);
+  return merge_cells(merge_sort_cells(l, half, context), merge_sort_cells(right, length - half, context), context);
+}
+
+
+/* Sorts the cells of l in place and returns the new first cell. Each cell
+   other than the first is referenced by its predecessor, so the old and new
+   first cells trade that reference. */
+
+data_t *sort_list_in_place(data_t *l, sort_context_t *context)
+{
+  suspend_heap_checks();
+  data_t *sorted = merge_sort_cells(l, length_of(l), context);
+  resume_heap_checks();
+  if (sorted != l) {
+    retain(l);
+    disown(sorted);
+  }
+  return sorted;
+}
+
+
+void merge_sort_array(data_t **items, data_t **scratch, int count, sort_context_t *context)
+{
+  if (count < 2) {
+    return;
+  }
+  int half = count / 2;
+  merge_sort_array(items, scratch, half, context);
+  merge_sort_array(items + half, scratch, count - half, context);
+
+  int left = 0;
+  int right = half;
+  int out = 0;
+  while (left < half && right < count) {
+    if (sort_before(context, items[right], items[left])) {
+      scratch[out++] = items[right++];
+    } else {
+      scratch[out++] = items[left++];
+    }
+  }
+  while (left < half) {
+    scratch[out++] = items[left++];
+  }
+  memcpy(items, scratch, out * sizeof(data_t*));
+}
+
+
+pvector_t *sorted_pvector(pvector_t *v, sort_context_t *context)
+{
+  data_t **items = (data_t**)malloc(v->count * sizeof(data_t*));
+  data_t **scratch = (data_t**)malloc(v->count * sizeof(data_t*));
+  for (int i = 0; i < v->count; i++) {
+    items[i] = pvector_ref(v, i);
+  }
+  merge_sort_array(items, scratch, v->count, context);
+
+  pvector_t *sorted = pvector_empty();
+  for (int i = 0; i < v->count; i++) {
+    pvector_t *pushed = pvector_push(sorted, items[i]);
+    pvector_release(sorted);
+    sorted = pushed;
+  }
+  free(scratch);
+  free(items);
+  return sorted;
+}
+
+
+bool check_sort_args(data_t *args, char *name, char **err_ptr)
+{
+  data_t *sequence = car(args);
+  data_t *f = car(cdr(args));
+  if (!listp(sequence) && !pvectorp(sequence)) {
+    char *buf = (char*)malloc((64 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s requires a list or vector as it's first argument", name);
+    *err_ptr = buf;
+    return false;
+  }
+  if (type_of(f) != FUNCTION_TYPE && type_of(f) != PRIMITIVE_TYPE) {
+    char *buf = (char*)malloc((48 + strlen(name)) * sizeof(char));
+    sprintf(buf, "%s requires a function as it's second argument", name);
+    *err_ptr = buf;
+    return false;
+  }
+  return true;
+}
+
+
+data_t *sort_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_sort_args(args, "sort", err_ptr)) {
+    return NULL;
+  }
+  data_t *sequence = car(args);
+  sort_context_t context;
+  init_sort_context(&context, car(cdr(args)), env, err_ptr);
+
+  data_t *result;
+  if (pvectorp(sequence)) {
+    result = pvector_with_value(sorted_pvector(pvector_value(sequence), &context));
+  } else {
+    Vector items;
+    vector_init(&items);
+    for (data_t *cell = sequence; cell != NULL; cell = cdr(cell)) {
+      vector_append(&items, car(cell));
+    }
+    result = sort_list_in_place(vector_to_list(&items), &context);
+    vector_free(&items);
+  }
+  free_sort_context(&context);
+
+  if (*err_ptr != NULL) {
+    release(result);
+    return NULL;
+  }
+  return result;
+}
+
+
+/* Destructive sort. Lists are relinked so the original first cell may no
+   longer be first; use the result. Vectors get the sorted contents in
+   their own cell, so every reference to the vector sees them sorted. As
+   with any change to a key, a vector sorted while it is a hash map key
+   (which hashes by contents) won't be found under it again. */
+
+data_t *sort_bang_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (!check_sort_args(args, "sort!", err_ptr)) {
+    return NULL;
+  }
+  data_t *sequence = car(args);
+  sort_context_t context;
+  init_sort_context(&context, car(cdr(args)), env, err_ptr);
+
+  data_t *result = sequence;
+  if (pvectorp(sequence)) {
+    pvector_t *sorted = sorted_pvector(pvector_value(sequence), &context);
+    if (*err_ptr == NULL) {
+      set_pvector_value(sequence, sorted);
+    } else {
+      pvector_release(sorted);
+    }
+  } else {
+    result = sort_list_in_place(sequence, &context);
+  }
+  free_sort_context(&context);
+
+  if (*err_ptr != NULL) {
+    return NULL;
+  }
+  return result;
+}
+
+
+/* data_t *gc_impl(data_t *args, environment_frame_t *env, char **err_ptr) */
+/* { */
 /*   gc(); */
 /*   return NULL; */
 /* } */
@@ -918,6 +2306,18 @@ void register_primitives(void)
   register_primitive("integer", 1, &integer_impl);
   register_primitive("unsigned", 1, &unsigned_impl);
 
+  register_primitive("string-length", 1, &string_length_impl);
+  register_primitive("string-ref", 2, &string_ref_impl);
+  register_primitive("substring", -1, &substring_impl);
+  register_primitive("string-append", -1, &string_append_impl);
+  register_primitive("string=?", 2, &string_equal_impl);
+  register_primitive("number->string", 1, &number_to_string_impl);
+  register_primitive("string->number", 1, &string_to_number_impl);
+  register_primitive("make-string-builder", -1, &make_string_builder_impl);
+  register_primitive("string-builder-append!", -1, &string_builder_append_impl);
+  register_primitive("string-builder->string", 1, &string_builder_to_string_impl);
+  register_primitive("string-builder-length", 1, &string_builder_length_impl);
+
   register_primitive("list", -1, &list_impl);
   register_primitive("cons", 2, &cons_impl);
   register_primitive("car", 1, &car_impl);
@@ -972,6 +2372,48 @@ void register_primitives(void)
   register_primitive("append", -1, &append_impl);
   register_primitive("append!", -1, &appendbang_impl);
 
+  register_primitive("assq", 2, &assq_impl);
+  register_primitive("assv", 2, &assq_impl);
+  register_primitive("assoc", 2, &assoc_impl);
+  register_primitive("memq", 2, &memq_impl);
+  register_primitive("memv", 2, &memq_impl);
+  register_primitive("member", 2, &member_impl);
+
+  register_primitive("map", -1, &map_impl);
+  register_primitive("for-each", -1, &for_each_impl);
+  register_primitive("pmap", 2, &pmap_impl);
+  register_primitive("pfor-each", 2, &pfor_each_impl);
+  register_primitive("filter", 2, &filter_impl);
+  register_primitive("fold", 3, &fold_impl);
+  register_primitive("reduce", 3, &reduce_impl);
+  register_primitive("apply", -1, &apply_impl);
+
+  register_primitive("hash-map", -1, &hash_map_impl);
+  register_primitive("hash-map?", 1, &hash_mapp_impl);
+  register_primitive("hash-map-ref", -1, &hash_map_ref_impl);
+  register_primitive("hash-map-contains?", 2, &hash_map_contains_impl);
+  register_primitive("hash-map-assoc", -1, &hash_map_assoc_impl);
+  register_primitive("hash-map-dissoc", -1, &hash_map_dissoc_impl);
+  register_primitive("hash-map-update", -1, &hash_map_update_impl);
+  register_primitive("hash-map-count", 1, &hash_map_count_impl);
+  register_primitive("hash-map-keys", 1, &hash_map_keys_impl);
+  register_primitive("hash-map->list", 1, &hash_map_to_list_impl);
+
+  register_primitive("vector", -1, &vector_impl);
+  register_primitive("vector?", 1, &vectorp_impl);
+  register_primitive("vector-length", 1, &vector_length_impl);
+  register_primitive("vector-ref", 2, &vector_ref_impl);
+  register_primitive("vector-set", 3, &vector_set_impl);
+  register_primitive("vector-update", 3, &vector_update_impl);
+  register_primitive("vector-push", 2, &vector_push_impl);
+  register_primitive("vector-pop", 1, &vector_pop_impl);
+  register_primitive("vector-append", -1, &vector_append_impl);
+  register_primitive("vector->list", 1, &vector_to_list_impl);
+  register_primitive("list->vector", 1, &list_to_vector_impl);
+
+  register_primitive("sort", 2, &sort_impl);
+  register_primitive("sort!", 2, &sort_bang_impl);
+
   register_primitive("eq?", 2, &eq_impl);
   register_primitive("neq?", 2, &neq_impl);
   register_primitive("<", 2, &lt_impl);
@@ -987,10 +2429,16 @@ void register_primitives(void)
   register_primitive("unsigned?", 1, &unsignedp_impl);
   register_primitive("function?", 1, &functionp_impl);
   register_primitive("macro?", 1, &macrop_impl);
+  register_primitive("record?", 1, &recordp_impl);
 
   register_primitive("definition", 1, &definition_impl);
   register_primitive("heap-size", 0, &heap_size_impl);
   register_primitive("free-size", 0, &free_size_impl);
+  register_primitive("runtime-stats", 0, &runtime_stats_impl);
+  register_primitive("reset-runtime-stats", 0, &reset_runtime_stats_impl);
+  register_primitive("heap-profile", 0, &heap_profile_impl);
+  register_primitive("heap-check", 0, &heap_check_impl);
+  register_primitive("heap-snapshot", 1, &heap_snapshot_impl);
 
   /* register_primitive("gc", 0, &gc_impl); */
 }
@@ -0,0 +1,200 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the per-function call count and time profiler. */
+
+/* Each application of a function or primitive pushes an activation holding
+   its start time.  On exit the elapsed time is charged to the callee as
+   inclusive time, and to the caller as time spent in children, so self time
+   is what is left over.  Recursive calls only add inclusive time when the
+   outermost activation returns, so it is never counted twice. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "profiler.h"
+#include "dictionary.h"
+
+typedef struct profile_entry_t {
+  char *name;
+  int kind;
+  long calls;
+  int64_t inclusive_ns;
+  int64_t self_ns;
+  int active;
+} profile_entry_t;
+
+typedef struct profile_activation_t {
+  profile_entry_t *entry;
+  int64_t start;
+  int64_t child_ns;
+} profile_activation_t;
+
+bool profiling = false;
+
+static dictionary_t *profile_entries = NULL;
+static int number_of_entries = 0;
+
+static profile_activation_t *activations = NULL;
+static int activation_depth = 0;
+static int activation_capacity = 0;
+
+
+static int64_t now_ns(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+void profile_start(void)
+{
+  if (profile_entries == NULL) {
+    profile_entries = new_dictionary();
+  }
+  profiling = true;
+}
+
+
+void profile_stop(void)
+{
+  profiling = false;
+}
+
+
+static void free_entry(void *data)
+{
+  profile_entry_t *entry = (profile_entry_t*)data;
+  free(entry->name);
+  free(entry);
+}
+
+
+void profile_clear(void)
+{
+  if (profile_entries != NULL) {
+    with_each_value_do(profile_entries, &free_entry);
+    clean_dictionary(profile_entries);
+    free(profile_entries);
+    profile_entries = NULL;
+  }
+  number_of_entries = 0;
+  activation_depth = 0;
+}
+
+
+static profile_entry_t *entry_named(char *name, int kind)
+{
+  profile_entry_t *entry = (profile_entry_t*)dictionary_get(profile_entries, name);
+  if (entry == NULL) {
+    entry = (profile_entry_t*)malloc(sizeof(profile_entry_t));
+    entry->name = strdup(name);
+    entry->kind = kind;
+    entry->calls = 0;
+    entry->inclusive_ns = 0;
+    entry->self_ns = 0;
+    entry->active = 0;
+    dictionary_put(profile_entries, entry->name, entry);
+    number_of_entries++;
+  }
+  return entry;
+}
+
+
+void profile_enter(char *name, int kind)
+{
+  if (activation_depth == activation_capacity) {
+    activation_capacity = (activation_capacity == 0) ? 64 : activation_capacity * 2;
+    activations = (profile_activation_t*)realloc(activations, activation_capacity * sizeof(profile_activation_t));
+  }
+  profile_entry_t *entry = entry_named(name, kind);
+  entry->calls++;
+  entry->active++;
+  profile_activation_t *activation = &activations[activation_depth++];
+  activation->entry = entry;
+  activation->child_ns = 0;
+  activation->start = now_ns();
+}
+
+
+void profile_exit(void)
+{
+  if (activation_depth == 0) {
+    return;
+  }
+  profile_activation_t *activation = &activations[--activation_depth];
+  int64_t elapsed = now_ns() - activation->start;
+  profile_entry_t *entry = activation->entry;
+  entry->self_ns += elapsed - activation->child_ns;
+  if (--entry->active == 0) {
+    entry->inclusive_ns += elapsed;
+  }
+  if (activation_depth > 0) {
+    activations[activation_depth - 1].child_ns += elapsed;
+  }
+}
+
+
+/********************************************************************************/
+/* reporting                                                                    */
+/********************************************************************************/
+
+static profile_entry_t **report_entries;
+static int report_count;
+
+
+static void collect_entry(void *data)
+{
+  report_entries[report_count++] = (profile_entry_t*)data;
+}
+
+
+static int by_self_time(const void *a, const void *b)
+{
+  profile_entry_t *x = *(profile_entry_t**)a;
+  profile_entry_t *y = *(profile_entry_t**)b;
+  if (x->self_ns != y->self_ns) {
+    return (x->self_ns > y->self_ns) ? -1 : 1;
+  }
+  return strcmp(x->name, y->name);
+}
+
+
+char *profile_kind_name(int kind)
+{
+  switch (kind) {
+  case PROFILE_PRIMITIVE:
+    return "primitive";
+  case PROFILE_SPECIAL_FORM:
+    return "special form";
+  case PROFILE_MACRO:
+    return "macro";
+  default:
+    return "function";
+  }
+}
+
+
+void profile_report(FILE *out)
+{
+  if (profile_entries == NULL || number_of_entries == 0) {
+    fprintf(out, "No calls profiled.\n");
+    return;
+  }
+  report_entries = (profile_entry_t**)malloc(number_of_entries * sizeof(profile_entry_t*));
+  report_count = 0;
+  with_each_value_do(profile_entries, &collect_entry);
+  qsort(report_entries, report_count, sizeof(profile_entry_t*), &by_self_time);
+
+  fprintf(out, "%10s %14s %14s  %-12s %s\n", "calls", "inclusive ms", "self ms", "kind", "name");
+  for (int i = 0; i < report_count; i++) {
+    profile_entry_t *entry = report_entries[i];
+    fprintf(out, "%10ld %14.3f %14.3f  %-12s %s\n",
+            entry->calls, entry->inclusive_ns / 1e6, entry->self_ns / 1e6,
+            profile_kind_name(entry->kind), entry->name);
+  }
+  free(report_entries);
+}
@@ -0,0 +1,32 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the per-function call count and time profiler. */
+
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PROFILE_FUNCTION 0
+#define PROFILE_PRIMITIVE 1
+#define PROFILE_SPECIAL_FORM 2
+#define PROFILE_MACRO 3
+
+/* Checked at each application; when false the profiler costs one branch */
+
+extern bool profiling;
+
+void profile_start(void);
+void profile_stop(void);
+void profile_clear(void);
+void profile_enter(char *name, int kind);
+void profile_exit(void);
+void profile_report(FILE *out);
+char *profile_kind_name(int kind);
+
+#endif
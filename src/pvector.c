@@ -0,0 +1,260 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the persistent vector (radix balanced trie). */
+
+/* Element i is found by taking 5 bits of i per level, so indexing and
+   functional updates touch O(log32 n) nodes. Updates copy the path to the
+   changed leaf and share every other node with the original vector. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "data.h"
+#include "pvector.h"
+
+
+pvector_node_t *new_pvector_node(void)
+{
+  pvector_node_t *node = (pvector_node_t*)malloc(sizeof(pvector_node_t));
+  node->refs = 1;
+  memset(node->slots, 0, sizeof(node->slots));
+  return node;
+}
+
+
+void release_pvector_node(pvector_node_t *node, int level)
+{
+  if (node == NULL || --node->refs > 0) {
+    return;
+  }
+  for (int i = 0; i < PVECTOR_WIDTH; i++) {
+    if (level == 0) {
+      release((data_t*)node->slots[i]);
+    } else {
+      release_pvector_node((pvector_node_t*)node->slots[i], level - PVECTOR_BITS);
+    }
+  }
+  free(node);
+}
+
+
+/* The copy takes its own reference to everything in the node */
+
+pvector_node_t *copy_pvector_node(pvector_node_t *node, int level)
+{
+  pvector_node_t *copy = new_pvector_node();
+  for (int i = 0; i < PVECTOR_WIDTH; i++) {
+    copy->slots[i] = node->slots[i];
+    if (node->slots[i] == NULL) {
+      continue;
+    }
+    if (level == 0) {
+      retain((data_t*)node->slots[i]);
+    } else {
+      ((pvector_node_t*)node->slots[i])->refs++;
+    }
+  }
+  return copy;
+}
+
+
+pvector_t *new_pvector(int count, int shift, pvector_node_t *root, pvector_node_t *tail)
+{
+  pvector_t *v = (pvector_t*)malloc(sizeof(pvector_t));
+  v->count = count;
+  v->shift = shift;
+  v->root = root;
+  v->tail = tail;
+  return v;
+}
+
+
+pvector_t *pvector_empty(void)
+{
+  return new_pvector(0, PVECTOR_BITS, new_pvector_node(), new_pvector_node());
+}
+
+
+void pvector_release(pvector_t *v)
+{
+  release_pvector_node(v->root, v->shift);
+  release_pvector_node(v->tail, 0);
+  free(v);
+}
+
+
+int tail_offset(pvector_t *v)
+{
+  if (v->count < PVECTOR_WIDTH) {
+    return 0;
+  }
+  return ((v->count - 1) >> PVECTOR_BITS) << PVECTOR_BITS;
+}
+
+
+pvector_node_t *leaf_for(pvector_t *v, int index)
+{
+  if (index >= tail_offset(v)) {
+    return v->tail;
+  }
+  pvector_node_t *node = v->root;
+  for (int level = v->shift; level > 0; level -= PVECTOR_BITS) {
+    node = (pvector_node_t*)node->slots[(index >> level) & PVECTOR_MASK];
+  }
+  return node;
+}
+
+
+data_t *pvector_ref(pvector_t *v, int index)
+{
+  return (data_t*)leaf_for(v, index)->slots[index & PVECTOR_MASK];
+}
+
+
+pvector_node_t *assoc_in_node(int level, pvector_node_t *node, int index, data_t *value)
+{
+  pvector_node_t *copy = copy_pvector_node(node, level);
+  int slot = (index >> level) & PVECTOR_MASK;
+  if (level == 0) {
+    release((data_t*)copy->slots[slot]);
+    copy->slots[slot] = retain(value);
+  } else {
+    pvector_node_t *child = assoc_in_node(level - PVECTOR_BITS, (pvector_node_t*)node->slots[slot], index, value);
+    release_pvector_node((pvector_node_t*)copy->slots[slot], level - PVECTOR_BITS);
+    copy->slots[slot] = child;
+  }
+  return copy;
+}
+
+
+pvector_t *pvector_set(pvector_t *v, int index, data_t *value)
+{
+  v->root->refs++;
+  v->tail->refs++;
+  if (index >= tail_offset(v)) {
+    pvector_node_t *tail = assoc_in_node(0, v->tail, index, value);
+    release_pvector_node(v->tail, 0);
+    return new_pvector(v->count, v->shift, v->root, tail);
+  }
+  pvector_node_t *root = assoc_in_node(v->shift, v->root, index, value);
+  release_pvector_node(v->root, v->shift);
+  return new_pvector(v->count, v->shift, root, v->tail);
+}
+
+
+pvector_node_t *new_path(int level, pvector_node_t *node)
+{
+  if (level == 0) {
+    return node;
+  }
+  pvector_node_t *path = new_pvector_node();
+  path->slots[0] = new_path(level - PVECTOR_BITS, node);
+  return path;
+}
+
+
+/* Takes ownership of tail */
+
+pvector_node_t *push_tail(pvector_t *v, int level, pvector_node_t *parent, pvector_node_t *tail)
+{
+  int slot = ((v->count - 1) >> level) & PVECTOR_MASK;
+  pvector_node_t *copy = copy_pvector_node(parent, level);
+  pvector_node_t *inserted;
+  if (level == PVECTOR_BITS) {
+    inserted = tail;
+  } else if (parent->slots[slot] != NULL) {
+    inserted = push_tail(v, level - PVECTOR_BITS, (pvector_node_t*)parent->slots[slot], tail);
+  } else {
+    inserted = new_path(level - PVECTOR_BITS, tail);
+  }
+  release_pvector_node((pvector_node_t*)copy->slots[slot], level - PVECTOR_BITS);
+  copy->slots[slot] = inserted;
+  return copy;
+}
+
+
+pvector_t *pvector_push(pvector_t *v, data_t *value)
+{
+  int tail_count = v->count - tail_offset(v);
+  if (tail_count < PVECTOR_WIDTH) {
+    pvector_node_t *tail = copy_pvector_node(v->tail, 0);
+    tail->slots[tail_count] = retain(value);
+    v->root->refs++;
+    return new_pvector(v->count + 1, v->shift, v->root, tail);
+  }
+
+  /* The tail is full: move it into the tree and start a new one */
+  v->tail->refs++;
+  pvector_node_t *root;
+  int shift = v->shift;
+  if ((v->count >> PVECTOR_BITS) > (1 << v->shift)) {
+    root = new_pvector_node();
+    v->root->refs++;
+    root->slots[0] = v->root;
+    root->slots[1] = new_path(v->shift, v->tail);
+    shift += PVECTOR_BITS;
+  } else {
+    root = push_tail(v, v->shift, v->root, v->tail);
+  }
+  pvector_node_t *tail = new_pvector_node();
+  tail->slots[0] = retain(value);
+  return new_pvector(v->count + 1, shift, root, tail);
+}
+
+
+pvector_node_t *pop_tail(pvector_t *v, int level, pvector_node_t *node)
+{
+  int slot = ((v->count - 2) >> level) & PVECTOR_MASK;
+  if (level > PVECTOR_BITS) {
+    pvector_node_t *child = pop_tail(v, level - PVECTOR_BITS, (pvector_node_t*)node->slots[slot]);
+    if (child == NULL && slot == 0) {
+      return NULL;
+    }
+    pvector_node_t *copy = copy_pvector_node(node, level);
+    release_pvector_node((pvector_node_t*)copy->slots[slot], level - PVECTOR_BITS);
+    copy->slots[slot] = child;
+    return copy;
+  } else if (slot == 0) {
+    return NULL;
+  } else {
+    pvector_node_t *copy = copy_pvector_node(node, level);
+    release_pvector_node((pvector_node_t*)copy->slots[slot], level - PVECTOR_BITS);
+    copy->slots[slot] = NULL;
+    return copy;
+  }
+}
+
+
+pvector_t *pvector_pop(pvector_t *v)
+{
+  if (v->count <= 1) {
+    return pvector_empty();
+  }
+  int tail_count = v->count - tail_offset(v);
+  if (tail_count > 1) {
+    pvector_node_t *tail = copy_pvector_node(v->tail, 0);
+    release((data_t*)tail->slots[tail_count - 1]);
+    tail->slots[tail_count - 1] = NULL;
+    v->root->refs++;
+    return new_pvector(v->count - 1, v->shift, v->root, tail);
+  }
+
+  /* The tail empties: the last leaf of the tree becomes the new tail */
+  pvector_node_t *tail = leaf_for(v, v->count - 2);
+  tail->refs++;
+  pvector_node_t *root = pop_tail(v, v->shift, v->root);
+  int shift = v->shift;
+  if (root == NULL) {
+    root = new_pvector_node();
+  }
+  if (shift > PVECTOR_BITS && root->slots[1] == NULL) {
+    pvector_node_t *only_child = (pvector_node_t*)root->slots[0];
+    only_child->refs++;
+    release_pvector_node(root, shift);
+    root = only_child;
+    shift -= PVECTOR_BITS;
+  }
+  return new_pvector(v->count - 1, shift, root, tail);
+}
@@ -0,0 +1,40 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the persistent vector (radix balanced trie). */
+
+#ifndef __PVECTOR_H
+#define __PVECTOR_H
+
+typedef struct data_t data_t;
+
+#define PVECTOR_BITS 5
+#define PVECTOR_WIDTH (1 << PVECTOR_BITS)
+#define PVECTOR_MASK (PVECTOR_WIDTH - 1)
+
+/* Interior nodes hold child nodes, leaves hold elements. Nodes are shared
+   between vectors and reference counted. The last (up to) 32 elements live
+   in a separate tail leaf so appending rarely touches the tree. */
+
+typedef struct pvector_node_t {
+  int refs;
+  void *slots[PVECTOR_WIDTH];
+} pvector_node_t;
+
+typedef struct pvector_t {
+  int count;
+  int shift;
+  pvector_node_t *root;
+  pvector_node_t *tail;
+} pvector_t;
+
+pvector_t *pvector_empty(void);
+data_t *pvector_ref(pvector_t *v, int index);
+pvector_t *pvector_set(pvector_t *v, int index, data_t *value);
+pvector_t *pvector_push(pvector_t *v, data_t *value);
+pvector_t *pvector_pop(pvector_t *v);
+void pvector_release(pvector_t *v);
+
+#endif
@@ -0,0 +1,33 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the record type support. */
+
+#ifndef __RECORD_H
+#define __RECORD_H
+
+typedef struct data_t data_t;
+
+typedef struct record_type_t {
+  char *name;
+  int number_of_fields;
+  data_t **field_names;
+} record_type_t;
+
+/* The procedures produced by define-record-type are primitives carrying one
+   of these as their context, so each access is a single slot load. */
+
+typedef struct record_constructor_t {
+  record_type_t *type;
+  int number_of_arguments;
+  int *slot_for_argument;
+} record_constructor_t;
+
+typedef struct record_accessor_t {
+  record_type_t *type;
+  int slot;
+} record_accessor_t;
+
+#endif
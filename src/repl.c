@@ -1,7 +1,9 @@
 #include <stdio.h>
+#include <inttypes.h>
 #include <readline/readline.h>
 #include <readline/history.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include "data.h"
 #include "parser.h"
@@ -11,6 +13,17 @@
 #include "primitives.h"
 #include "logging.h"
 #include "serial_handler.h"
+#include "stats.h"
+#include "profiler.h"
+#include "sampler.h"
+#include "heap_profile.h"
+#include "leak_check.h"
+#include "heap_check.h"
+#include "tracer.h"
+#include "ring_handler.h"
+#include "server.h"
+#include "parallel.h"
+#include "interp.h"
 
 
 static char *line_read = (char *)NULL;
@@ -32,13 +45,92 @@ char *rl_gets (char *prompt)
 }
 
 
+char *read_source_file(char *filename)
+{
+     FILE *f = fopen(filename, "r");
+     if (f == NULL) {
+          return NULL;
+     }
+     fseek(f, 0, SEEK_END);
+     long size = ftell(f);
+     fseek(f, 0, SEEK_SET);
+     char *source = (char*)malloc(size + 1);
+     size_t length = fread(source, 1, size, f);
+     source[length] = '\0';
+     fclose(f);
+     return source;
+}
+
+
+/* Counters are taken at the start of the run so that interpreter
+   initialization isn't charged to the program being measured. */
+
+typedef struct run_start_t {
+     struct timespec time;
+     uint64_t evaluations;
+     uint64_t allocations;
+} run_start_t;
+
+
+void mark_run_start(run_start_t *start)
+{
+     clock_gettime(CLOCK_MONOTONIC, &start->time);
+     start->evaluations = current_interp->stats.evaluations;
+     start->allocations = total_cells_allocated();
+}
+
+
+/* Writes one JSON line describing the run so benchmark scripts can collect it */
+
+void print_run_stats(run_start_t *start)
+{
+     struct timespec end;
+     clock_gettime(CLOCK_MONOTONIC, &end);
+     double wall_ms = (end.tv_sec - start->time.tv_sec) * 1000.0 + (end.tv_nsec - start->time.tv_nsec) / 1000000.0;
+     printf("{\"wall_ms\": %.3f, \"evaluations\": %" PRIu64 ", \"cells_allocated\": %" PRIu64 ", \"cells_in_use\": %d}\n",
+            wall_ms, current_interp->stats.evaluations - start->evaluations, total_cells_allocated() - start->allocations, cells_allocated());
+}
+
+
+/* With -p the whole run is profiled and the report goes to stderr so it
+   stays out of the program's own output.  With -S the folded stacks are
+   written to the named file, with -T the trace is, and with -A the
+   allocation sites of the cells still live are reported. */
+
+void finish_profile(void)
+{
+     trace_stop();
+     sampler_stop();
+     if (profiling) {
+          profile_stop();
+          profile_report(stderr);
+          profile_clear();
+     }
+     if (heap_profiling) {
+          heap_profile_report(stderr);
+          heap_profile_stop();
+     }
+}
+
+
 int
 main(int argc, char* argv[])
 {
      char c;
      char *log_level = "ERROR";
      char *expr = NULL;
-     while ((c = getopt (argc, argv, "l:e:")) != -1) {
+     char *filename = NULL;
+     bool report_stats = false;
+     bool profile_run = false;
+     bool profile_heap = false;
+     bool check_leaks = false;
+     char *sample_filename = NULL;
+     char *trace_filename = NULL;
+     bool async_logging = false;
+     char *socket_path = NULL;
+     int number_of_workers = 0;
+     int sample_rate = DEFAULT_SAMPLE_RATE;
+     while ((c = getopt (argc, argv, "l:e:f:spS:r:ALC:T:au:w:j:")) != -1) {
           switch (c)
           {
           case 'l':
@@ -47,6 +139,45 @@ main(int argc, char* argv[])
           case 'e':
                expr = optarg;
                break;
+          case 'f':
+               filename = optarg;
+               break;
+          case 's':
+               report_stats = true;
+               break;
+          case 'p':
+               profile_run = true;
+               break;
+          case 'S':
+               sample_filename = optarg;
+               break;
+          case 'r':
+               sample_rate = atoi(optarg);
+               break;
+          case 'A':
+               profile_heap = true;
+               break;
+          case 'L':
+               check_leaks = true;
+               break;
+          case 'C':
+               heap_check_interval = atoi(optarg);
+               break;
+          case 'T':
+               trace_filename = optarg;
+               break;
+          case 'a':
+               async_logging = true;
+               break;
+          case 'u':
+               socket_path = optarg;
+               break;
+          case 'w':
+               number_of_workers = atoi(optarg);
+               break;
+          case 'j':
+               set_parallel_workers(atoi(optarg));
+               break;
           }
      }
 
@@ -54,6 +185,11 @@ main(int argc, char* argv[])
      serial_handler_init(0);
      log_init_logger(&serial_handler);
      log_set_level(ERROR);
+     if (async_logging) {
+          ring_handler_init(&serial_write_line);
+          ring_handler_start_thread();
+          atexit(&ring_handler_stop);
+     }
      log_info("Initializing");
 
      using_history();
@@ -65,7 +201,91 @@ main(int argc, char* argv[])
 
      log_set_level(log_level_for(log_level));
 
-     if (expr) {
+     run_start_t start;
+     mark_run_start(&start);
+     if (profile_run) {
+          profile_start();
+     }
+     if (profile_heap) {
+          heap_profile_start();
+     }
+#ifndef DEBUG_TRACE
+     if (heap_check_interval > 0) {
+          log_error("Periodic heap checks need a DEBUG_TRACE build; use (heap-check) instead");
+     }
+#endif
+     if (sample_filename != NULL && !sampler_start(sample_filename, sample_rate, &err)) {
+          log_error("%s", err);
+          free(err);
+          return 1;
+     }
+     if (trace_filename != NULL && !trace_start(trace_filename, &err)) {
+          log_error("%s", err);
+          free(err);
+          return 1;
+     }
+
+     if (socket_path) {
+          /* A file given with -u is a prelude, loaded before serving (and
+             before forking, so workers share it) */
+          if (filename) {
+               char *source = read_source_file(filename);
+               if (source == NULL) {
+                    log_error("Could not read %s", filename);
+                    return 1;
+               }
+               set_source_name(filename);
+               data_t *result = parse_and_eval_all(source, &err);
+               free(source);
+               if (err) {
+                    log_error("%s", err);
+                    free(err);
+                    return 1;
+               }
+               if (unreferencedp(result)) {
+                    release(result);
+               }
+          }
+          bool served = run_server(socket_path, number_of_workers, &err);
+          finish_profile();
+          if (!served) {
+               log_error("%s", err);
+               free(err);
+               return 1;
+          }
+          if (report_stats) {
+               print_run_stats(&start);
+          }
+          return 0;
+     } else if (filename) {
+          char *source = read_source_file(filename);
+          if (source == NULL) {
+               log_error("Could not read %s", filename);
+               return 1;
+          }
+          set_source_name(filename);
+          data_t *result = parse_and_eval_all(source, &err);
+          free(source);
+          finish_profile();
+          if (err) {
+               log_error("%s", err);
+               free(err);
+               return 1;
+          }
+          char *result_string = to_string(result);
+          printf("%s\n", result_string);
+          free(result_string);
+          if (unreferencedp(result)) {
+               release(result);
+          }
+          if (report_stats) {
+               print_run_stats(&start);
+          }
+          if (check_leaks) {
+               report_leaks(stderr);
+          }
+          return 0;
+     } else if (expr) {
           log_debug("heap size: %d, allocated: %d, remaining: %d", total_cells(), cells_allocated(), cells_remaining());
            data_t *sexpr = parse(expr, &err);
            if (err != NULL) {
@@ -73,9 +293,11 @@ main(int argc, char* argv[])
                 free(err);
            } else {
                 data_t *result = evaluate(sexpr, GLOBAL_ENV, &err);
+                finish_profile();
                 if (err) {
                      log_error("%s", err);
                      free(err);
+                     release(sexpr);
                 } else {
                      char *result_string = to_string(result);
                      printf("%s\n", result_string);
@@ -85,6 +307,12 @@ main(int argc, char* argv[])
                           release(result);
                      }
                      log_debug("heap size: %d, allocated: %d, remaining: %d", total_cells(), cells_allocated(), cells_remaining());
+                     if (report_stats) {
+                          print_run_stats(&start);
+                     }
+                }
+                if (check_leaks) {
+                     report_leaks(stderr);
                 }
            }
      } else {
@@ -123,5 +351,6 @@ main(int argc, char* argv[])
                }
           }
      }
+     finish_profile();
      write_history("./.history");
 }
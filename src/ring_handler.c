@@ -0,0 +1,445 @@
+// Asynchronous ring buffer logging handler
+//
+// Copyright (c) 2023 Dave Astels
+
+/* Logging through this handler only copies the message's level, time,
+   format pointer and raw arguments into a ring buffer; formatting and
+   output happen later, on a background thread on the host or from the idle
+   loop on the MCU.  The format string is walked to find each argument's
+   type.  Strings are copied, since callers commonly free them right after
+   logging; format strings must be literals, which they are everywhere in
+   the interpreter.
+
+   Several threads may log at once (parallel map workers do) and a single
+   consumer drains.  A producer claims its space by advancing reserved,
+   writes its record there, then advances head past it once the producers
+   that claimed earlier space have; the consumer only reads up to head and
+   only advances tail.  When a message does not fit it is dropped and
+   counted rather than blocking the interpreter. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <time.h>
+#include "logging.h"
+#include "ring_handler.h"
+
+#ifndef ARDUINO
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE (16 * 1024)
+#endif
+#define MAX_RECORD_SIZE 1024
+#define MAX_STRING_ARGUMENT 256
+#define MAX_LINE_LENGTH 1024
+
+/* Each record starts with this header; a header with length 0 marks the
+   rest of the ring as unused so the next record starts at the front. */
+typedef struct log_record_t {
+     uint32_t length;
+     uint8_t level;
+     time_t when;
+     const char *format;
+} log_record_t;
+
+#define ARGUMENT_INT 'i'
+#define ARGUMENT_LONG 'l'
+#define ARGUMENT_LONG_LONG 'q'
+#define ARGUMENT_SIZE 'z'
+#define ARGUMENT_DOUBLE 'd'
+#define ARGUMENT_LONG_DOUBLE 'D'
+#define ARGUMENT_POINTER 'p'
+#define ARGUMENT_STRING 's'
+
+static unsigned char ring[LOG_RING_SIZE];
+static atomic_uint_fast32_t reserved = 0;
+static atomic_uint_fast32_t head = 0;
+static atomic_uint_fast32_t tail = 0;
+static atomic_long dropped = 0;
+static LogLineWriter line_writer = NULL;
+
+
+/********************************************************************************/
+/* format specifications                                                        */
+/********************************************************************************/
+
+/* Finds the next conversion in a format, returning a pointer to its '%' (or
+   to the end of the string) and filling in its length, how many '*' widths
+   it takes, and the type of the argument it converts. */
+
+static const char *next_conversion(const char *format, int *length, int *stars, char *argument_type)
+{
+     while (true) {
+          const char *start = strchr(format, '%');
+          if (start == NULL) {
+               return format + strlen(format);
+          }
+          const char *c = start + 1;
+          if (*c == '%') {
+               format = c + 1;
+               continue;
+          }
+          *stars = 0;
+          while (strchr("-+ #0", *c) && *c) {
+               c++;
+          }
+          while ((*c >= '0' && *c <= '9') || *c == '*' || *c == '.') {
+               *stars += *c == '*';
+               c++;
+          }
+          int longs = 0;
+          bool size = false;
+          bool long_double = false;
+          while (strchr("hlLzjt", *c) && *c) {
+               longs += *c == 'l';
+               size |= *c == 'z' || *c == 'j' || *c == 't';
+               long_double |= *c == 'L';
+               c++;
+          }
+          if (*c == '\0') {
+               return c;
+          }
+          switch (*c) {
+          case 'd': case 'i': case 'o': case 'u': case 'x': case 'X': case 'c':
+               *argument_type = size ? ARGUMENT_SIZE : (longs >= 2) ? ARGUMENT_LONG_LONG : (longs == 1) ? ARGUMENT_LONG : ARGUMENT_INT;
+               break;
+          case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+               *argument_type = long_double ? ARGUMENT_LONG_DOUBLE : ARGUMENT_DOUBLE;
+               break;
+          case 's':
+               *argument_type = ARGUMENT_STRING;
+               break;
+          default:
+               *argument_type = ARGUMENT_POINTER;
+               break;
+          }
+          *length = c + 1 - start;
+          return start;
+     }
+}
+
+
+/********************************************************************************/
+/* producer                                                                     */
+/********************************************************************************/
+
+#define COPY_ARGUMENT(type, value)                                \
+     do {                                                        \
+          type v = (value);                                       \
+          if (used + sizeof(type) > MAX_RECORD_SIZE) {            \
+               return 0;                                          \
+          }                                                       \
+          memcpy(record + used, &v, sizeof(type));                \
+          used += sizeof(type);                                   \
+     } while (0)
+
+
+/* Copies the arguments after the header, returning the record's length or
+   0 if it is too big */
+
+static size_t encode_arguments(unsigned char *record, const char *format, va_list args)
+{
+     size_t used = sizeof(log_record_t);
+     int length, stars;
+     char argument_type;
+     for (const char *c = next_conversion(format, &length, &stars, &argument_type); *c; c = next_conversion(c + length, &length, &stars, &argument_type)) {
+          for (int i = 0; i < stars; i++) {
+               COPY_ARGUMENT(int, va_arg(args, int));
+          }
+          switch (argument_type) {
+          case ARGUMENT_INT:
+               COPY_ARGUMENT(int, va_arg(args, int));
+               break;
+          case ARGUMENT_LONG:
+               COPY_ARGUMENT(long, va_arg(args, long));
+               break;
+          case ARGUMENT_LONG_LONG:
+               COPY_ARGUMENT(long long, va_arg(args, long long));
+               break;
+          case ARGUMENT_SIZE:
+               COPY_ARGUMENT(size_t, va_arg(args, size_t));
+               break;
+          case ARGUMENT_DOUBLE:
+               COPY_ARGUMENT(double, va_arg(args, double));
+               break;
+          case ARGUMENT_LONG_DOUBLE:
+               COPY_ARGUMENT(long double, va_arg(args, long double));
+               break;
+          case ARGUMENT_POINTER:
+               COPY_ARGUMENT(void*, va_arg(args, void*));
+               break;
+          case ARGUMENT_STRING:
+               {
+                    const char *s = va_arg(args, const char*);
+                    if (s == NULL) {
+                         s = "(null)";
+                    }
+                    size_t n = strnlen(s, MAX_STRING_ARGUMENT - 1);
+                    if (used + n + 1 > MAX_RECORD_SIZE) {
+                         return 0;
+                    }
+                    memcpy(record + used, s, n);
+                    record[used + n] = '\0';
+                    used += n + 1;
+               }
+               break;
+          }
+     }
+     return used;
+}
+
+
+/* Records are published in the order their space was claimed, so a
+   producer waits for those that claimed before it to finish writing */
+
+static void publish(uint_fast32_t start, uint_fast32_t end)
+{
+     uint_fast32_t expected = start;
+     while (!atomic_compare_exchange_weak_explicit(&head, &expected, (uint32_t)end,
+                                                   memory_order_release, memory_order_relaxed)) {
+          expected = start;
+#ifndef ARDUINO
+          sched_yield();
+#endif
+     }
+}
+
+
+static void ring_handler_log(LogLevel level, const char *format, va_list args)
+{
+     unsigned char record[MAX_RECORD_SIZE];
+     size_t length = encode_arguments(record, format, args);
+     if (length == 0) {
+          atomic_fetch_add(&dropped, 1);
+          return;
+     }
+     length = (length + 7) & ~(size_t)7;
+     log_record_t header = {length, level, time(NULL), format};
+     memcpy(record, &header, sizeof(header));
+
+     uint_fast32_t h = atomic_load_explicit(&reserved, memory_order_relaxed);
+     uint32_t offset, skip;
+     do {
+          uint32_t t = atomic_load_explicit(&tail, memory_order_acquire);
+          offset = (uint32_t)h % LOG_RING_SIZE;
+          skip = (offset + length > LOG_RING_SIZE) ? LOG_RING_SIZE - offset : 0;
+          if ((uint32_t)h + skip + length - t > LOG_RING_SIZE) {
+               atomic_fetch_add(&dropped, 1);
+               return;
+          }
+     } while (!atomic_compare_exchange_weak_explicit(&reserved, &h, (uint32_t)(h + skip + length),
+                                                     memory_order_relaxed, memory_order_relaxed));
+     if (skip > 0) {
+          if (skip >= sizeof(uint32_t)) {
+               uint32_t wrap = 0;
+               memcpy(ring + offset, &wrap, sizeof(wrap));
+          }
+          offset = 0;
+     }
+     memcpy(ring + offset, record, length);
+     publish(h, h + skip + length);
+}
+
+
+/********************************************************************************/
+/* consumer                                                                     */
+/********************************************************************************/
+
+#define TAKE_ARGUMENT(type, into) \
+     do { memcpy(&into, arguments, sizeof(type)); arguments += sizeof(type); } while (0)
+
+
+/* Formats one conversion with the arguments it took, which follow each
+   other in the record */
+
+static int format_conversion(char *out, size_t room, const char *spec, int stars, char argument_type, const unsigned char **arguments_ptr)
+{
+     const unsigned char *arguments = *arguments_ptr;
+     int widths[2] = {0, 0};
+     for (int i = 0; i < stars; i++) {
+          TAKE_ARGUMENT(int, widths[i]);
+     }
+     int written = 0;
+
+#define FORMAT_WITH(value)                                                        \
+     written = (stars == 0) ? snprintf(out, room, spec, value)                 \
+          : (stars == 1) ? snprintf(out, room, spec, widths[0], value)           \
+          : snprintf(out, room, spec, widths[0], widths[1], value)
+
+     switch (argument_type) {
+     case ARGUMENT_INT: { int v; TAKE_ARGUMENT(int, v); FORMAT_WITH(v); } break;
+     case ARGUMENT_LONG: { long v; TAKE_ARGUMENT(long, v); FORMAT_WITH(v); } break;
+     case ARGUMENT_LONG_LONG: { long long v; TAKE_ARGUMENT(long long, v); FORMAT_WITH(v); } break;
+     case ARGUMENT_SIZE: { size_t v; TAKE_ARGUMENT(size_t, v); FORMAT_WITH(v); } break;
+     case ARGUMENT_DOUBLE: { double v; TAKE_ARGUMENT(double, v); FORMAT_WITH(v); } break;
+     case ARGUMENT_LONG_DOUBLE: { long double v; TAKE_ARGUMENT(long double, v); FORMAT_WITH(v); } break;
+     case ARGUMENT_POINTER: { void *v; TAKE_ARGUMENT(void*, v); FORMAT_WITH(v); } break;
+     case ARGUMENT_STRING:
+          {
+               const char *v = (const char*)arguments;
+               arguments += strlen(v) + 1;
+               FORMAT_WITH(v);
+          }
+          break;
+     }
+#undef FORMAT_WITH
+
+     *arguments_ptr = arguments;
+     return (written < 0) ? 0 : ((size_t)written >= room) ? (int)room - 1 : written;
+}
+
+
+static void format_record(const log_record_t *header, const unsigned char *arguments, char *line)
+{
+     char *out = line;
+     size_t room = MAX_LINE_LENGTH;
+     const char *literal = header->format;
+     int length, stars;
+     char argument_type;
+     char spec[32];
+     for (const char *c = next_conversion(literal, &length, &stars, &argument_type); ; c = next_conversion(c + length, &length, &stars, &argument_type)) {
+          /* Literal text, where %% stands for % */
+          for (const char *l = literal; l < c && room > 1; l++) {
+               *out++ = *l;
+               room--;
+               if (*l == '%' && l[1] == '%') {
+                    l++;
+               }
+          }
+          if (*c == '\0' || room <= 1) {
+               break;
+          }
+          if (length >= (int)sizeof(spec)) {
+               length = sizeof(spec) - 1;
+          }
+          memcpy(spec, c, length);
+          spec[length] = '\0';
+          int written = format_conversion(out, room, spec, stars, argument_type, &arguments);
+          out += written;
+          room -= written;
+          literal = c + length;
+     }
+     *out = '\0';
+}
+
+
+void ring_handler_drain(void)
+{
+     char line[MAX_LINE_LENGTH];
+     uint32_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+     uint32_t h = atomic_load_explicit(&head, memory_order_acquire);
+     while (t != h) {
+          uint32_t offset = t % LOG_RING_SIZE;
+          uint32_t length = 0;
+          if (LOG_RING_SIZE - offset >= sizeof(uint32_t)) {
+               memcpy(&length, ring + offset, sizeof(length));
+          }
+          if (length == 0) {
+               t += LOG_RING_SIZE - offset;
+               continue;
+          }
+          log_record_t header;
+          memcpy(&header, ring + offset, sizeof(header));
+          format_record(&header, ring + offset + sizeof(header), line);
+          if (line_writer) {
+               line_writer(log_format_at(log_name_for_level((LogLevel)header.level), line, header.when));
+          }
+          t += length;
+          atomic_store_explicit(&tail, t, memory_order_release);
+     }
+     atomic_store_explicit(&tail, t, memory_order_release);
+}
+
+
+/********************************************************************************/
+/* draining in the background                                                   */
+/********************************************************************************/
+
+#ifndef ARDUINO
+
+static pthread_t drain_thread;
+static atomic_bool draining = false;
+
+
+static void *drain_in_background(void *unused)
+{
+     while (atomic_load(&draining)) {
+          ring_handler_drain();
+          usleep(1000);
+     }
+     ring_handler_drain();
+     return NULL;
+}
+
+
+bool ring_handler_start_thread(void)
+{
+     atomic_store(&draining, true);
+     if (pthread_create(&drain_thread, NULL, &drain_in_background, NULL) != 0) {
+          atomic_store(&draining, false);
+          return false;
+     }
+     return true;
+}
+
+
+void ring_handler_stop(void)
+{
+     if (atomic_load(&draining)) {
+          atomic_store(&draining, false);
+          pthread_join(drain_thread, NULL);
+     } else {
+          ring_handler_drain();
+     }
+}
+
+/* fork copies the ring but not the drain thread: the parent still owns and
+   will write the records already queued, so the child skips them and starts
+   its own thread if the parent was draining in the background */
+
+void ring_handler_after_fork(void)
+{
+     atomic_store(&tail, atomic_load(&head));
+     atomic_store(&reserved, atomic_load(&head));
+     if (atomic_load(&draining)) {
+          ring_handler_start_thread();
+     }
+}
+
+#else
+
+/* The MCU has no threads; call ring_handler_drain from the idle loop */
+
+bool ring_handler_start_thread(void)
+{
+     return false;
+}
+
+
+void ring_handler_stop(void)
+{
+     ring_handler_drain();
+}
+
+#endif
+
+
+void ring_handler_init(LogLineWriter writer)
+{
+     line_writer = writer;
+     log_set_deferred_handler(&ring_handler_log);
+}
+
+
+long ring_handler_dropped(void)
+{
+     return atomic_load(&dropped);
+}
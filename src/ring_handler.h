@@ -0,0 +1,20 @@
+// Asynchronous ring buffer logging handler
+//
+// Copyright (c) 2023 Dave Astels
+
+#ifndef __RING_HANDLER_H__
+#define __RING_HANDLER_H__
+
+#include <stdbool.h>
+
+/* Receives each finished log line when the ring is drained */
+typedef void (*LogLineWriter)(const char *line);
+
+void ring_handler_init(LogLineWriter writer);
+void ring_handler_drain(void);
+bool ring_handler_start_thread(void);
+void ring_handler_stop(void);
+void ring_handler_after_fork(void);
+long ring_handler_dropped(void);
+
+#endif
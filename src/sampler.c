@@ -0,0 +1,281 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the sampling profiler and the shadow call stack it
+   samples. */
+
+/* A profiling timer interrupts the interpreter at the requested rate of CPU
+   time.  Each sample is the shadow stack folded into one line, outermost
+   frame first, separated by semicolons, and counted in a hash table of the
+   distinct stacks seen, so a long run only grows with the number of
+   different stacks.  When sampling stops the stacks are written as "stack
+   count" lines, the folded format flame graph tools read.
+
+   The kernel only checks the timer on its scheduler tick, so rates above
+   MAX_SAMPLE_RATE are lowered to it, and fewer samples than asked for are
+   reported when sampling stops. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <time.h>
+#include "sampler.h"
+
+#define STACK_BUCKETS 1024
+
+bool sampling = false;
+volatile sig_atomic_t sample_pending = 0;
+char *shadow_stack[SHADOW_STACK_DEPTH];
+int shadow_depth = 0;
+int shadow_function_depth = 0;
+int shadow_function_depths[SHADOW_STACK_DEPTH];
+int shadow_stack_users = 0;
+
+typedef struct folded_stack_t {
+  char *stack;
+  uint32_t hash;
+  long count;
+  struct folded_stack_t *next;
+} folded_stack_t;
+
+static char *sample_filename = NULL;
+static int sample_rate = 0;
+static struct timespec sampling_started;
+static folded_stack_t *stacks[STACK_BUCKETS];
+static int number_of_stacks = 0;
+static long number_of_samples = 0;
+
+/* The stack being sampled is folded here, and only copied if it's new */
+static char *folded = NULL;
+static size_t folded_capacity = 0;
+
+
+void acquire_shadow_stack(void)
+{
+  if (shadow_stack_users++ == 0) {
+    shadow_depth = 0;
+    shadow_function_depth = 0;
+  }
+}
+
+
+void release_shadow_stack(void)
+{
+  if (shadow_stack_users > 0 && --shadow_stack_users == 0) {
+    shadow_depth = 0;
+    shadow_function_depth = 0;
+  }
+}
+
+
+/* Name of the function being applied, or NULL at the top level */
+
+char *innermost_frame(void)
+{
+  if (shadow_depth == 0) {
+    return NULL;
+  }
+  return shadow_stack[(shadow_depth <= SHADOW_STACK_DEPTH) ? shadow_depth - 1 : SHADOW_STACK_DEPTH - 1];
+}
+
+
+/* Name of the Lisp function being applied, or NULL outside any */
+
+char *innermost_function_frame(void)
+{
+  if (shadow_function_depth == 0 || shadow_function_depth > SHADOW_STACK_DEPTH) {
+    return NULL;
+  }
+  return shadow_stack[shadow_function_depth - 1];
+}
+
+
+static void request_sample(int signal_number)
+{
+  sample_pending = 1;
+}
+
+
+static void set_sample_timer(int rate)
+{
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = (rate > 0) ? 1000000 / rate : 0;
+  timer.it_value = timer.it_interval;
+  setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+
+static double cpu_seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+
+bool sampler_start(char *filename, int rate, char **err_ptr)
+{
+  if (rate <= 0) {
+    *err_ptr = strdup("Sample rate must be at least 1 per second");
+    return false;
+  }
+  if (rate > MAX_SAMPLE_RATE) {
+    fprintf(stderr, "The profiling timer can't deliver %d samples per second; sampling at %d\n", rate, MAX_SAMPLE_RATE);
+    rate = MAX_SAMPLE_RATE;
+  }
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &request_sample;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, NULL) != 0) {
+    *err_ptr = strdup("Could not install the SIGPROF handler");
+    return false;
+  }
+  sample_filename = filename;
+  sample_rate = rate;
+  sample_pending = 0;
+  sampling = true;
+  acquire_shadow_stack();
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &sampling_started);
+  set_sample_timer(rate);
+  return true;
+}
+
+
+/* Folds the current stack into the buffer, returning its hash */
+
+static uint32_t fold_stack(void)
+{
+  int depth = (shadow_depth < SHADOW_STACK_DEPTH) ? shadow_depth : SHADOW_STACK_DEPTH;
+  size_t length = 16;
+  for (int i = 0; i < depth; i++) {
+    length += strlen(shadow_stack[i]) + 1;
+  }
+  if (length > folded_capacity) {
+    folded_capacity = (length > 2 * folded_capacity) ? length : 2 * folded_capacity;
+    folded = (char*)realloc(folded, folded_capacity * sizeof(char));
+  }
+  char *end = folded;
+  strcpy(end, "[toplevel]");
+  end += strlen(end);
+  for (int i = 0; i < depth; i++) {
+    *end++ = ';';
+    strcpy(end, shadow_stack[i]);
+    end += strlen(end);
+  }
+
+  uint32_t hash = 5381;
+  for (char *c = folded; *c; c++) {
+    hash = ((hash << 5) + hash) + *c;
+  }
+  return hash;
+}
+
+
+void take_sample(void)
+{
+  sample_pending = 0;
+  number_of_samples++;
+  uint32_t hash = fold_stack();
+  folded_stack_t **bucket = &stacks[hash % STACK_BUCKETS];
+  for (folded_stack_t *entry = *bucket; entry != NULL; entry = entry->next) {
+    if (entry->hash == hash && strcmp(entry->stack, folded) == 0) {
+      entry->count++;
+      return;
+    }
+  }
+  folded_stack_t *entry = (folded_stack_t*)malloc(sizeof(folded_stack_t));
+  entry->stack = strdup(folded);
+  entry->hash = hash;
+  entry->count = 1;
+  entry->next = *bucket;
+  *bucket = entry;
+  number_of_stacks++;
+}
+
+
+static int by_stack(const void *a, const void *b)
+{
+  return strcmp((*(folded_stack_t**)a)->stack, (*(folded_stack_t**)b)->stack);
+}
+
+
+static void write_folded_stacks(FILE *out)
+{
+  folded_stack_t **sorted = (folded_stack_t**)malloc(number_of_stacks * sizeof(folded_stack_t*));
+  int n = 0;
+  for (int i = 0; i < STACK_BUCKETS; i++) {
+    for (folded_stack_t *entry = stacks[i]; entry != NULL; entry = entry->next) {
+      sorted[n++] = entry;
+    }
+  }
+  qsort(sorted, n, sizeof(folded_stack_t*), &by_stack);
+  for (int i = 0; i < n; i++) {
+    fprintf(out, "%s %ld\n", sorted[i]->stack, sorted[i]->count);
+  }
+  free(sorted);
+}
+
+
+static void free_folded_stacks(void)
+{
+  for (int i = 0; i < STACK_BUCKETS; i++) {
+    folded_stack_t *next;
+    for (folded_stack_t *entry = stacks[i]; entry != NULL; entry = next) {
+      next = entry->next;
+      free(entry->stack);
+      free(entry);
+    }
+    stacks[i] = NULL;
+  }
+  number_of_stacks = 0;
+  number_of_samples = 0;
+  free(folded);
+  folded = NULL;
+  folded_capacity = 0;
+}
+
+
+/* Tells the user when the timer fired well below the rate asked for, so
+   the counts aren't read as finer grained than they are */
+
+static void report_delivered_rate(void)
+{
+  double elapsed = cpu_seconds() - (sampling_started.tv_sec + sampling_started.tv_nsec / 1e9);
+  if (elapsed < 0.1) {
+    return;
+  }
+  double delivered = number_of_samples / elapsed;
+  if (delivered < sample_rate / 2) {
+    fprintf(stderr, "Took %.0f samples per second of CPU time rather than %d; the kernel's timer tick limits the rate\n", delivered, sample_rate);
+  }
+}
+
+
+void sampler_stop(void)
+{
+  if (!sampling) {
+    return;
+  }
+  set_sample_timer(0);
+  signal(SIGPROF, SIG_IGN);
+  sampling = false;
+  sample_pending = 0;
+  release_shadow_stack();
+  report_delivered_rate();
+
+  FILE *out = fopen(sample_filename, "w");
+  if (out == NULL) {
+    fprintf(stderr, "Could not write samples to %s\n", sample_filename);
+  } else {
+    write_folded_stacks(out);
+    fclose(out);
+  }
+  free_folded_stacks();
+}
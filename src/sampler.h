@@ -0,0 +1,89 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the sampling profiler and the shadow call stack it
+   samples. */
+
+#ifndef __SAMPLER_H
+#define __SAMPLER_H
+
+#include <stdbool.h>
+#include <signal.h>
+
+#define SHADOW_STACK_DEPTH 1024
+#define DEFAULT_SAMPLE_RATE 1000
+
+/* The profiling timer is checked on the kernel's scheduler tick, which is
+   at most 1000 times a second */
+#define MAX_SAMPLE_RATE 1000
+
+/* The shadow stack holds the name of every function, primitive and macro
+   being applied.  It is only maintained while something uses it: the
+   sampler, or the allocation site profiler.  Users must acquire it before
+   evaluation starts so pushes and pops stay balanced. */
+
+extern bool sampling;
+extern volatile sig_atomic_t sample_pending;
+extern int shadow_stack_users;
+extern char *shadow_stack[SHADOW_STACK_DEPTH];
+extern int shadow_depth;
+extern int shadow_function_depth;
+extern int shadow_function_depths[SHADOW_STACK_DEPTH];
+
+void acquire_shadow_stack(void);
+void release_shadow_stack(void);
+char *innermost_frame(void);
+char *innermost_function_frame(void);
+
+bool sampler_start(char *filename, int rate, char **err_ptr);
+void sampler_stop(void);
+void take_sample(void);
+
+
+/* The timer signal only sets sample_pending; the stack is recorded at the
+   next push or pop, where it is safe to allocate.  Pop samples before it
+   removes the frame so time in a long running primitive is charged to it. */
+
+static inline void shadow_push(char *name)
+{
+  if (shadow_stack_users > 0) {
+    if (shadow_depth < SHADOW_STACK_DEPTH) {
+      shadow_stack[shadow_depth] = name;
+      shadow_function_depths[shadow_depth] = shadow_function_depth;
+    }
+    shadow_depth++;
+    if (sample_pending) {
+      take_sample();
+    }
+  }
+}
+
+
+/* Lisp functions also record how deep they are, so the function an
+   allocation happened under can be found past the primitives it called */
+
+static inline void shadow_push_function(char *name)
+{
+  if (shadow_stack_users > 0) {
+    shadow_push(name);
+    shadow_function_depth = shadow_depth;
+  }
+}
+
+
+static inline void shadow_pop(void)
+{
+  if (shadow_stack_users > 0 && shadow_depth > 0) {
+    if (sample_pending) {
+      take_sample();
+    }
+    shadow_depth--;
+    if (shadow_depth < SHADOW_STACK_DEPTH) {
+      shadow_function_depth = shadow_function_depths[shadow_depth];
+    }
+  }
+}
+
+#endif
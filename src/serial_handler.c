@@ -28,3 +28,12 @@ void serial_handler(const char *level_name, const char *msg)
      /* Serial.flush(); */
      printf("%s\n", log_format(level_name, msg));
 }
+
+
+/* Writes a line that is already formatted, for the ring buffer handler */
+
+void serial_write_line(const char *line)
+{
+     /* Serial.println(line); */
+     printf("%s\n", line);
+}
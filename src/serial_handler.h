@@ -9,6 +9,7 @@
 
 bool serial_handler_init(unsigned long timeout);
 void serial_handler(const char *level_name, const char *msg);
+void serial_write_line(const char *line);
 
 
 
@@ -0,0 +1,446 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the Unix domain socket evaluation server. */
+
+/* A single thread serves every connection from one poll loop, so requests
+   from all clients see, and update, the same global environment.  Sockets
+   are non-blocking and replies are buffered, so a client that pipelines
+   far ahead of its reads never stalls the server.
+
+   To use more cores, a supervisor can instead fork workers from the warm
+   interpreter, after freezing its heap so reference counting in the
+   workers doesn't copy the shared pages.  Connections are spread across
+   the workers by whichever accepts first; each worker's environment then
+   evolves separately. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "data.h"
+#include "parser.h"
+#include "logging.h"
+#include "ring_handler.h"
+#include "server.h"
+
+#define MAX_CLIENTS 16
+#define MAX_REQUEST_SIZE (1024 * 1024)
+#define READ_CHUNK 4096
+
+typedef struct buffer_t {
+  char *bytes;
+  size_t used;
+  size_t capacity;
+} buffer_t;
+
+typedef struct client_t {
+  int fd;
+  buffer_t in;
+  buffer_t out;
+  size_t out_sent;
+  bool finished;
+  long requests;
+  double total_us;
+  double max_us;
+} client_t;
+
+static volatile sig_atomic_t stopping = 0;
+
+
+static void stop_serving(int signal_number)
+{
+  stopping = 1;
+}
+
+
+/********************************************************************************/
+/* buffers                                                                      */
+/********************************************************************************/
+
+static void buffer_reserve(buffer_t *b, size_t more)
+{
+  if (b->used + more > b->capacity) {
+    size_t capacity = (b->capacity == 0) ? READ_CHUNK : b->capacity;
+    while (capacity < b->used + more) {
+      capacity *= 2;
+    }
+    b->bytes = realloc(b->bytes, capacity);
+    b->capacity = capacity;
+  }
+}
+
+
+static void buffer_append(buffer_t *b, const void *bytes, size_t length)
+{
+  buffer_reserve(b, length);
+  memcpy(b->bytes + b->used, bytes, length);
+  b->used += length;
+}
+
+
+/* Drops the first count bytes */
+
+static void buffer_consume(buffer_t *b, size_t count)
+{
+  memmove(b->bytes, b->bytes + count, b->used - count);
+  b->used -= count;
+}
+
+
+/********************************************************************************/
+/* requests                                                                     */
+/********************************************************************************/
+
+static double microseconds_between(struct timespec *start, struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+
+static void send_reply(client_t *client, char *status, double us, char *text)
+{
+  char header[48];
+  int header_length = snprintf(header, sizeof(header), "%s %.1f ", status, us);
+  uint32_t length = header_length + strlen(text);
+  unsigned char prefix[4] = {length >> 24, length >> 16, length >> 8, length};
+  buffer_append(&client->out, prefix, 4);
+  buffer_append(&client->out, header, header_length);
+  buffer_append(&client->out, text, strlen(text));
+}
+
+
+static void evaluate_request(client_t *client, char *source)
+{
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  char *err = NULL;
+  data_t *result = parse_and_eval_all(source, &err);
+  char *text = (err != NULL) ? err : to_string(result);
+  if (err == NULL && unreferencedp(result)) {
+    release(result);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double us = microseconds_between(&start, &end);
+  client->requests++;
+  client->total_us += us;
+  if (us > client->max_us) {
+    client->max_us = us;
+  }
+  send_reply(client, (err != NULL) ? "error" : "ok", us, text);
+  free(text);
+}
+
+
+/* Evaluates every complete request in the input buffer; returns false if
+   the client sent something that can't be a request */
+
+static bool handle_requests(client_t *client)
+{
+  while (client->in.used >= 4) {
+    unsigned char *prefix = (unsigned char*)client->in.bytes;
+    uint32_t length = ((uint32_t)prefix[0] << 24) | (prefix[1] << 16) | (prefix[2] << 8) | prefix[3];
+    if (length > MAX_REQUEST_SIZE) {
+      log_error("Request of %u bytes is too large; closing the connection", length);
+      return false;
+    }
+    if (client->in.used < 4 + length) {
+      return true;
+    }
+    char *source = (char*)malloc(length + 1);
+    memcpy(source, client->in.bytes + 4, length);
+    source[length] = '\0';
+    buffer_consume(&client->in, 4 + length);
+    evaluate_request(client, source);
+    free(source);
+  }
+  return true;
+}
+
+
+/********************************************************************************/
+/* connections                                                                  */
+/********************************************************************************/
+
+static void close_client(client_t *client)
+{
+  if (client->requests > 0) {
+    log_info("Connection closed after %ld requests: mean %.1f us, max %.1f us",
+             client->requests, client->total_us / client->requests, client->max_us);
+  }
+  close(client->fd);
+  free(client->in.bytes);
+  free(client->out.bytes);
+  memset(client, 0, sizeof(client_t));
+  client->fd = -1;
+}
+
+
+/* Returns false if the client misbehaved or the connection failed.  When
+   the client has finished sending, its last requests are still answered. */
+
+static bool read_from_client(client_t *client)
+{
+  while (true) {
+    buffer_reserve(&client->in, READ_CHUNK);
+    ssize_t count = read(client->fd, client->in.bytes + client->in.used, READ_CHUNK);
+    if (count > 0) {
+      client->in.used += count;
+    } else if (count == 0) {
+      client->finished = true;
+      return handle_requests(client);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return handle_requests(client);
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+
+static bool write_to_client(client_t *client)
+{
+  while (client->out_sent < client->out.used) {
+    ssize_t count = write(client->fd, client->out.bytes + client->out_sent, client->out.used - client->out_sent);
+    if (count > 0) {
+      client->out_sent += count;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+  client->out.used = 0;
+  client->out_sent = 0;
+  return true;
+}
+
+
+static int listen_on(char *socket_path, char **err_ptr)
+{
+  struct sockaddr_un address;
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    *err_ptr = strdup("Socket path is too long");
+    return -1;
+  }
+  /* A socket left by an earlier run is replaced; anything else is kept */
+  struct stat existing;
+  if (lstat(socket_path, &existing) == 0) {
+    if (!S_ISSOCK(existing.st_mode)) {
+      char *buf = (char*)malloc((40 + strlen(socket_path)) * sizeof(char));
+      sprintf(buf, "%s exists and is not a socket", socket_path);
+      *err_ptr = buf;
+      return -1;
+    }
+    unlink(socket_path);
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    *err_ptr = strdup("Could not create the server socket");
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(fd, MAX_CLIENTS) < 0) {
+    char *buf = (char*)malloc((48 + strlen(socket_path)) * sizeof(char));
+    sprintf(buf, "Could not listen on %s", socket_path);
+    *err_ptr = buf;
+    close(fd);
+    return -1;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  return fd;
+}
+
+
+/* Serves connections on the listener until SIGINT or SIGTERM */
+
+static void serve(int listener)
+{
+  client_t clients[MAX_CLIENTS];
+  memset(clients, 0, sizeof(clients));
+  for (int i = 0; i < MAX_CLIENTS; i++) {
+    clients[i].fd = -1;
+  }
+
+  struct pollfd fds[MAX_CLIENTS + 1];
+  while (!stopping) {
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+      fds[i + 1].fd = clients[i].fd;
+      fds[i + 1].events = (clients[i].finished ? 0 : POLLIN) | ((clients[i].out.used > 0) ? POLLOUT : 0);
+      fds[i + 1].revents = 0;
+    }
+    if (poll(fds, MAX_CLIENTS + 1, -1) < 0) {
+      continue;
+    }
+
+    /* With several workers on one listener, all of them wake for a new
+       connection and all but one find nothing to accept */
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listener, NULL, NULL);
+      if (fd >= 0) {
+        int slot = 0;
+        while (slot < MAX_CLIENTS && clients[slot].fd != -1) {
+          slot++;
+        }
+        if (slot == MAX_CLIENTS) {
+          log_error("Too many connections; refusing one");
+          close(fd);
+        } else {
+          fcntl(fd, F_SETFL, O_NONBLOCK);
+          clients[slot].fd = fd;
+        }
+      }
+    }
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+      client_t *client = &clients[i];
+      short events = fds[i + 1].revents;
+      if (client->fd == -1 || fds[i + 1].fd != client->fd || events == 0) {
+        continue;
+      }
+      bool healthy = true;
+      if (!client->finished && (events & (POLLIN | POLLHUP | POLLERR))) {
+        healthy = read_from_client(client);
+      }
+      healthy = healthy && write_to_client(client);
+      if (!healthy || (client->finished && client->out.used == 0)) {
+        close_client(client);
+      }
+    }
+  }
+
+  for (int i = 0; i < MAX_CLIENTS; i++) {
+    if (clients[i].fd != -1) {
+      close_client(&clients[i]);
+    }
+  }
+}
+
+
+/********************************************************************************/
+/* worker pool                                                                  */
+/********************************************************************************/
+
+/* Forks a worker that serves until told to stop; returns its pid, or -1 */
+
+static pid_t start_worker(int listener, int number)
+{
+  fflush(stdout);
+  fflush(stderr);
+  pid_t pid = fork();
+  if (pid == 0) {
+    ring_handler_after_fork();
+    serve(listener);
+    /* Skip atexit handlers, which belong to the supervisor, but still
+       flush this worker's own log lines */
+    ring_handler_stop();
+    fflush(stdout);
+    fflush(stderr);
+    _exit(0);
+  } else if (pid < 0) {
+    log_error("Could not start worker %d", number);
+  } else {
+    log_info("Started worker %d as process %d", number, (int)pid);
+  }
+  return pid;
+}
+
+
+/* The supervisor never evaluates anything itself, so its heap stays as it
+   was when the workers were forked; a worker that dies is replaced by a
+   fresh fork of that same state. */
+
+static void supervise(int listener, int number_of_workers)
+{
+  pid_t *workers = (pid_t*)malloc(number_of_workers * sizeof(pid_t));
+  freeze_heap();
+  for (int i = 0; i < number_of_workers; i++) {
+    workers[i] = start_worker(listener, i);
+  }
+
+  while (!stopping) {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      continue;
+    }
+    for (int i = 0; i < number_of_workers; i++) {
+      if (workers[i] != pid) {
+        continue;
+      }
+      if (stopping) {
+        /* Shutting down: the worker went with the rest, nothing to restart */
+        workers[i] = -1;
+      } else {
+        if (WIFSIGNALED(status)) {
+          log_error("Worker %d died with signal %d; restarting it", i, WTERMSIG(status));
+        } else {
+          log_error("Worker %d exited with status %d; restarting it", i, WEXITSTATUS(status));
+        }
+        workers[i] = start_worker(listener, i);
+      }
+    }
+  }
+
+  for (int i = 0; i < number_of_workers; i++) {
+    if (workers[i] > 0) {
+      kill(workers[i], SIGTERM);
+    }
+  }
+  for (int i = 0; i < number_of_workers; i++) {
+    if (workers[i] > 0) {
+      waitpid(workers[i], NULL, 0);
+    }
+  }
+  free(workers);
+}
+
+
+/* Serves until interrupted by SIGINT or SIGTERM.  With workers, the warm
+   interpreter is forked that many times and the workers share the socket;
+   otherwise this process serves it alone. */
+
+bool run_server(char *socket_path, int number_of_workers, char **err_ptr)
+{
+  *err_ptr = NULL;
+  int listener = listen_on(socket_path, err_ptr);
+  if (listener < 0) {
+    return false;
+  }
+  /* Without SA_RESTART, so the supervisor's waitpid returns on a signal */
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &stop_serving;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+  log_info("Serving on %s", socket_path);
+
+  if (number_of_workers > 0) {
+    supervise(listener, number_of_workers);
+  } else {
+    serve(listener);
+  }
+
+  close(listener);
+  unlink(socket_path);
+  return true;
+}
@@ -0,0 +1,24 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the Unix domain socket evaluation server. */
+
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#include <stdbool.h>
+
+/* Each request is a 4 byte big endian length followed by that much source,
+   which is evaluated in the global environment.  Each reply is framed the
+   same way and holds "ok <microseconds> <result>" or
+   "error <microseconds> <message>".  Replies come back in request order, so
+   clients can send many requests before reading any replies.
+
+   With workers, definitions made over one connection are only seen by
+   the worker that served it. */
+
+bool run_server(char *socket_path, int number_of_workers, char **err_ptr);
+
+#endif
@@ -15,6 +15,8 @@
 #include "evaluator.h"
 #include "primitive_function.h"
 #include "function.h"
+#include "parser.h"
+#include "profiler.h"
 
 
 data_t *lambda_impl(data_t *args, environment_frame_t *env, char **err_ptr)
@@ -28,7 +30,15 @@ data_t *lambda_impl(data_t *args, environment_frame_t *env, char **err_ptr)
     return NULL;
   }
 
-  return func_with_value(make_function("anonymous", arg_names, body, env));
+  /* Anonymous functions are named for where they were written */
+  char *name;
+  if (args != NULL && args->meta.line > 0) {
+    name = (char*)malloc((24 + strlen(get_source_name())) * sizeof(char));
+    sprintf(name, "lambda@%s:%d", get_source_name(), args->meta.line);
+  } else {
+    name = strdup("anonymous");
+  }
+  return func_with_value(make_function(name, arg_names, body, env));
 }
 
 
@@ -38,7 +48,7 @@ data_t *define_impl(data_t *args, environment_frame_t *env, char **err_ptr)
   data_t *declaration = car(args);
   if (symbolp(declaration)) {
     data_t *value = evaluate(car(cdr(args)), env, err_ptr);
-    bind(env, declaration, value);
+    bind_symbol(env, declaration, value);
     return value;
   } else if (listp(declaration)) {
     data_t *name = car(declaration);
@@ -54,8 +64,8 @@ data_t *define_impl(data_t *args, environment_frame_t *env, char **err_ptr)
     }
     data_t *body = cdr(args);
 
-    data_t *func = func_with_value(make_function(string_value(name), arg_names, body, env));
-    bind(env, name, func);
+    data_t *func = func_with_value(make_function(strdup(string_value(name)), arg_names, body, env));
+    bind_symbol(env, name, func);
     return func;
   } else {
     *err_ptr = strdup("Invalid definition");
@@ -76,8 +86,8 @@ data_t *defmacro_impl(data_t *args, environment_frame_t *env, char **err_ptr)
       return NULL;
     }
     data_t *body = car(cdr(args));
-    data_t *macro = macro_with_value(make_macro(string_value(name), params, body, env));
-    bind(env, name, macro);
+    data_t *macro = macro_with_value(make_macro(strdup(string_value(name)), params, body, env));
+    bind_symbol(env, name, macro);
     return macro;
   } else {
     *err_ptr = strdup("Invalid macro definition");
@@ -156,17 +166,15 @@ data_t *let_impl(data_t *args, environment_frame_t *env, char **err_ptr)
       go_out_of_scope(local_env);
       return NULL;
     }
-    bind(local_env, binding_name, binding_value);
+    bind_symbol(local_env, binding_name, binding_value);
   }
 
-  data_t *result = evaluate_each(cdr(args), local_env, err_ptr);
+  data_t *result = retain(evaluate_each(cdr(args), local_env, err_ptr));
+  go_out_of_scope(local_env);
   if (*err_ptr != NULL) {
-    go_out_of_scope(local_env);
     return NULL;
   }
-
-  go_out_of_scope(local_env);
-  return result;
+  return disown(result);
 }
 
 
@@ -188,17 +196,15 @@ data_t *letstar_impl(data_t *args, environment_frame_t *env, char **err_ptr)
       go_out_of_scope(local_env);
       return NULL;
     }
-    bind(local_env, binding_name, binding_value);
+    bind_symbol(local_env, binding_name, binding_value);
   }
 
-  data_t *result = evaluate_each(cdr(args), local_env, err_ptr);
+  data_t *result = retain(evaluate_each(cdr(args), local_env, err_ptr));
+  go_out_of_scope(local_env);
   if (*err_ptr != NULL) {
-    go_out_of_scope(local_env);
     return NULL;
   }
-
-  go_out_of_scope(local_env);
-  return result;
+  return disown(result);
 }
 
 
@@ -213,7 +219,7 @@ data_t *letrec_impl(data_t *args, environment_frame_t *env, char **err_ptr)
       *err_ptr = strdup("letrec requires symbols as binding names");
       return NULL;
     }
-    bind(local_env, binding_name, NULL);
+    bind_symbol(local_env, binding_name, NULL);
   }
 
   for (data_t *binding_cell = bindings; binding_cell != NULL; binding_cell = cdr(binding_cell)) {
@@ -279,10 +285,12 @@ data_t *process_quasiquoted(data_t *sexpr, int level, environment_frame_t *env,
       }
       data_t *result = evaluate(car(processed), env, err_ptr);
       if (*err_ptr != NULL) {
+        release(processed);
         return NULL;
       }
-      return cons(result, NULL);
-      return NULL;
+      data_t *wrapped = cons(result, NULL);
+      release(processed);
+      return wrapped;
     } else {
       data_t *processed = process_quasiquoted(car(cdr(sexpr)), level - 1, env, err_ptr);
       if (*err_ptr != NULL) {
@@ -296,11 +304,12 @@ data_t *process_quasiquoted(data_t *sexpr, int level, environment_frame_t *env,
       if (*err_ptr != NULL) {
         return NULL;
       }
-      data_t *result = evaluate(car(processed), env, err_ptr);
+      data_t *result = retain(evaluate(car(processed), env, err_ptr));
+      release(processed);
       if (*err_ptr != NULL) {
         return NULL;
       }
-      return result;
+      return disown(result);
     } else {
       data_t *processed = process_quasiquoted(car(cdr(sexpr)), level - 1, env, err_ptr);
       if (*err_ptr != NULL) {
@@ -318,7 +327,9 @@ data_t *process_quasiquoted(data_t *sexpr, int level, environment_frame_t *env,
       }
       vector_append(&parts, processed);
     }
-    data_t *flat = flatten(vector_to_list(&parts));
+    data_t *parts_list = vector_to_list(&parts);
+    data_t *flat = flatten(parts_list);
+    release(parts_list);
     vector_free(&parts);
     return cons(flat, NULL);
   }
@@ -332,7 +343,9 @@ data_t *quasiquote_impl(data_t *args, environment_frame_t *env, char **err_ptr)
   if (*err_ptr != NULL) {
     return NULL;
   }
-  return car(result);
+  data_t *value = retain(car(result));
+  release(result);
+  return disown(value);
 }
 
 
@@ -393,7 +406,7 @@ data_t *do_impl(data_t *args, environment_frame_t *env, char **err_ptr)
       go_out_of_scope(local_env);
       return NULL;
     }
-    bind(local_env, binding_name, binding_value);
+    bind_symbol(local_env, binding_name, binding_value);
   }
 
   data_t *termination = car(cdr(args));
@@ -411,12 +424,12 @@ data_t *do_impl(data_t *args, environment_frame_t *env, char **err_ptr)
       return NULL;
     }
     if (boolean_value(condition)) {
-      data_t *result = evaluate_each(cdr(termination), local_env, err_ptr);
+      data_t *result = retain(evaluate_each(cdr(termination), local_env, err_ptr));
       go_out_of_scope(local_env);
       if (*err_ptr != NULL) {
         return NULL;
       } else {
-        return result;
+        return disown(result);
       }
     }
 
@@ -438,6 +451,180 @@ data_t *do_impl(data_t *args, environment_frame_t *env, char **err_ptr)
 }
 
 
+/* Records */
+
+data_t *record_constructor_impl(void *context, data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  record_constructor_t *constructor = (record_constructor_t*)context;
+  data_t *record = record_with_type(constructor->type);
+  data_t *cell = args;
+  for (int i = 0; i < constructor->number_of_arguments; i++) {
+    record->data.record.slots[constructor->slot_for_argument[i]] = retain(car(cell));
+    cell = cdr(cell);
+  }
+  return record;
+}
+
+
+data_t *record_predicate_impl(void *context, data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  return boolean_with_value(record_type_of(car(args)) == (record_type_t*)context);
+}
+
+
+char *wrong_record_type(record_type_t *type)
+{
+  char *buf = (char*)malloc((48 + strlen(type->name)) * sizeof(char));
+  sprintf(buf, "Record accessor expected a %s record.", type->name);
+  return buf;
+}
+
+
+data_t *record_accessor_impl(void *context, data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  record_accessor_t *accessor = (record_accessor_t*)context;
+  data_t *record = car(args);
+  if (record_type_of(record) != accessor->type) {
+    *err_ptr = wrong_record_type(accessor->type);
+    return NULL;
+  }
+  *err_ptr = NULL;
+  return record->data.record.slots[accessor->slot];
+}
+
+
+data_t *record_modifier_impl(void *context, data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  record_accessor_t *accessor = (record_accessor_t*)context;
+  data_t *record = car(args);
+  if (record_type_of(record) != accessor->type) {
+    *err_ptr = wrong_record_type(accessor->type);
+    return NULL;
+  }
+  *err_ptr = NULL;
+  data_t *value = car(cdr(args));
+  retain(value);
+  release(record->data.record.slots[accessor->slot]);
+  record->data.record.slots[accessor->slot] = value;
+  return value;
+}
+
+
+int field_index(record_type_t *type, data_t *field_name)
+{
+  for (int i = 0; i < type->number_of_fields; i++) {
+    if (type->field_names[i] == field_name) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+void bind_record_procedure(environment_frame_t *env, data_t *name, int parameter_count, primitive_function_with_context_impl impl, void *context)
+{
+  bind_symbol(env, name, prim_with_value(make_primitive_function_with_context(string_value(name), parameter_count, impl, context)));
+}
+
+
+/* (define-record-type name (constructor field ...) predicate (field accessor [modifier]) ...) */
+
+data_t *define_record_type_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  *err_ptr = NULL;
+  if (length_of(args) < 3) {
+    *err_ptr = strdup("define-record-type requires a name, constructor, and predicate.");
+    return NULL;
+  }
+  data_t *type_name = car(args);
+  data_t *constructor_spec = car(cdr(args));
+  data_t *predicate_name = car(cdr(cdr(args)));
+  data_t *field_specs = cdr(cdr(cdr(args)));
+
+  if (!symbolp(type_name) || !symbolp(predicate_name)) {
+    *err_ptr = strdup("Record type and predicate names must be symbols");
+    return NULL;
+  }
+  if (!listp(constructor_spec) || constructor_spec == NULL || !all_of_type(SYMBOL_TYPE, constructor_spec)) {
+    *err_ptr = strdup("Record constructor must be a list of symbols");
+    return NULL;
+  }
+
+  Vector field_names;
+  vector_init(&field_names);
+  for (data_t *cell = field_specs; cell != NULL; cell = cdr(cell)) {
+    data_t *spec = car(cell);
+    if (!listp(spec) || length_of(spec) < 2 || length_of(spec) > 3 || !all_of_type(SYMBOL_TYPE, spec)) {
+      vector_free(&field_names);
+      *err_ptr = strdup("Record fields must be (field accessor [modifier])");
+      return NULL;
+    }
+    vector_append(&field_names, car(spec));
+  }
+  data_t *field_list = vector_to_list(&field_names);
+  vector_free(&field_names);
+  record_type_t *type = make_record_type(strdup(string_value(type_name)), field_list);
+  release(field_list);
+
+  record_constructor_t *constructor = (record_constructor_t*)malloc(sizeof(record_constructor_t));
+  constructor->type = type;
+  constructor->number_of_arguments = length_of(cdr(constructor_spec));
+  constructor->slot_for_argument = (int*)malloc(constructor->number_of_arguments * sizeof(int));
+  int argument_index = 0;
+  for (data_t *cell = cdr(constructor_spec); cell != NULL; cell = cdr(cell)) {
+    int slot = field_index(type, car(cell));
+    if (slot == -1) {
+      free(constructor->slot_for_argument);
+      free(constructor);
+      free(type->field_names);
+      free(type->name);
+      free(type);
+      *err_ptr = strdup("Record constructor names an unknown field");
+      return NULL;
+    }
+    constructor->slot_for_argument[argument_index++] = slot;
+  }
+
+  bind_record_procedure(env, car(constructor_spec), constructor->number_of_arguments, &record_constructor_impl, constructor);
+  bind_record_procedure(env, predicate_name, 1, &record_predicate_impl, type);
+  for (data_t *cell = field_specs; cell != NULL; cell = cdr(cell)) {
+    data_t *spec = car(cell);
+    record_accessor_t *accessor = (record_accessor_t*)malloc(sizeof(record_accessor_t));
+    accessor->type = type;
+    accessor->slot = field_index(type, car(spec));
+    bind_record_procedure(env, car(cdr(spec)), 1, &record_accessor_impl, accessor);
+    if (cdr(cdr(spec)) != NULL) {
+      bind_record_procedure(env, car(cdr(cdr(spec))), 2, &record_modifier_impl, accessor);
+    }
+  }
+
+  data_t *descriptor = record_type_with_value(type);
+  bind_symbol(env, type_name, descriptor);
+  return descriptor;
+}
+
+
+/* (profile expr) evaluates expr with the profiler on and prints a report of
+   the calls it made.  Nested inside a profiled run it just evaluates expr. */
+
+data_t *profile_impl(data_t *args, environment_frame_t *env, char **err_ptr)
+{
+  if (profiling) {
+    return evaluate(car(args), env, err_ptr);
+  }
+  profile_start();
+  data_t *result = retain(evaluate(car(args), env, err_ptr));
+  profile_stop();
+  if (*err_ptr == NULL) {
+    profile_report(stdout);
+  }
+  profile_clear();
+  return disown(result);
+}
+
+
 void register_special_forms(void)
 {
   register_special_form("lambda", -1, &lambda_impl);
@@ -455,4 +642,6 @@ void register_special_forms(void)
   register_special_form("unquote-splicing", 1, &unquote_splicing_impl);
   register_special_form("expand", -1, &expand_impl);
   register_special_form("do", -1, &do_impl);
+  register_special_form("define-record-type", -1, &define_record_type_impl);
+  register_special_form("profile", 1, &profile_impl);
 }
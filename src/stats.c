@@ -0,0 +1,27 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the runtime performance counters. */
+
+#include <string.h>
+#include "stats.h"
+#include "interp.h"
+
+
+void reset_runtime_stats(void)
+{
+  memset(&current_interp->stats, 0, sizeof(current_interp->stats));
+  current_interp->stack_base = 0;
+}
+
+
+uint64_t total_cells_allocated(void)
+{
+  uint64_t total = 0;
+  for (int i = 0; i < STATS_CELL_TYPES; i++) {
+    total += current_interp->stats.cells_allocated[i];
+  }
+  return total;
+}
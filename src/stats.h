@@ -0,0 +1,38 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the runtime performance counters. */
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdint.h>
+
+#define STATS_CELL_TYPES 16
+
+/* Counters are plain increments on the interpreter's context so they can
+   stay on in production builds.  They are 64 bits even where long is 32
+   bits, as on the nRF52840, so a long run can't overflow them. */
+
+typedef struct runtime_stats_t {
+  uint64_t evaluations;
+  uint64_t primitive_applications;
+  uint64_t function_applications;
+  uint64_t macro_applications;
+  uint64_t macro_expansions;
+  uint64_t frames_created;
+  uint64_t frames_freed;
+  uint64_t dictionary_lookups;
+  uint64_t dictionary_chain_steps;
+  uint64_t cells_allocated[STATS_CELL_TYPES];
+  uint64_t retains;
+  uint64_t releases;
+  uint64_t peak_stack_depth;
+} runtime_stats_t;
+
+void reset_runtime_stats(void);
+uint64_t total_cells_allocated(void);
+
+#endif
@@ -0,0 +1,29 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the string support. */
+
+#ifndef __STRING_BUFFER_H
+#define __STRING_BUFFER_H
+
+/* Strings carry their length. A substring is a view into the characters of
+   the string it was taken from, which is kept alive by the view's
+   reference, so only strings that own their characters are NUL
+   terminated. */
+
+typedef struct string_t {
+  int refs;
+  int length;
+  char *chars;
+  struct string_t *shared;
+} string_t;
+
+typedef struct string_builder_t {
+  int length;
+  int capacity;
+  char *chars;
+} string_builder_t;
+
+#endif
@@ -10,44 +10,54 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include "interp.h"
 
-token_t lookahead_token;
-char *lookahead_lit;
-char *source;
-int position;
+/* The state of the running interpreter's tokenizer */
+
+#define tokenizer (current_interp->tokenizer)
 
 
 void initialize_tokenizer(char *src_string)
 {
-  source = src_string;
-  lookahead_token = ILLEGAL;
-  lookahead_lit = (char*)0;
-  position = 0;
+  tokenizer.source = src_string;
+  tokenizer.lookahead_token = ILLEGAL;
+  tokenizer.lookahead_lit = (char*)0;
+  tokenizer.position = 0;
+  tokenizer.line = 1;
+  tokenizer.lookahead_line = 1;
   consume_token();
 }
 
 
 token_t get_token(void)
 {
-  return lookahead_token;
+  return tokenizer.lookahead_token;
 }
 
 
 char *get_lit(void)
 {
-  return lookahead_lit;
+  return tokenizer.lookahead_lit;
+}
+
+
+/* The source line the lookahead token starts on, counting from 1 */
+
+int get_line(void)
+{
+  return tokenizer.lookahead_line;
 }
 
 
 int is_eof(void)
 {
-  return position >= strlen(source);
+  return tokenizer.position >= strlen(tokenizer.source);
 }
 
 
 int is_almost_eof()
 {
-  return position == strlen(source) - 1;
+  return tokenizer.position == strlen(tokenizer.source) - 1;
 }
 
 
@@ -71,7 +81,7 @@ int is_hex_digit(char ch)
 
 int is_symbol_character(char ch)
 {
-  return is_letter(ch) || is_digit(ch) || ch == '*' || ch == '-' || ch == '?' || ch == '!' || ch == '_' || ch == '>' || ch == ':';
+  return is_letter(ch) || is_digit(ch) || ch == '*' || ch == '-' || ch == '?' || ch == '!' || ch == '_' || ch == '>' || ch == ':' || ch == '=';
 }
 
 int is_space(char ch)
@@ -82,42 +92,42 @@ int is_space(char ch)
 
 void extract_lit(int start)
 {
-  int size = position - start;
-  lookahead_lit = malloc(size + 1);
-  strncpy(lookahead_lit, source + start, size);
-  lookahead_lit[size] = 0;
+  int size = tokenizer.position - start;
+  tokenizer.lookahead_lit = malloc(size + 1);
+  strncpy(tokenizer.lookahead_lit, tokenizer.source + start, size);
+  tokenizer.lookahead_lit[size] = 0;
 }
 
 
 void read_symbol()
 {
-  int start = position;
-  while (!is_eof() && is_symbol_character(source[position])) {
-    position++;
+  int start = tokenizer.position;
+  while (!is_eof() && is_symbol_character(tokenizer.source[tokenizer.position])) {
+    tokenizer.position++;
   }
-  lookahead_token = SYMBOL;
+  tokenizer.lookahead_token = SYMBOL;
   extract_lit(start);
 }
 
 
 void read_number()
 {
-  int start = position;
+  int start = tokenizer.position;
   bool is_hex = false;
 
   while (!is_eof()) {
-    char ch = source[position];
+    char ch = tokenizer.source[tokenizer.position];
     if (ch == '#') {
-      position++;
-    } else if ((start == position) && ch == '-') {
-      position++;
+      tokenizer.position++;
+    } else if ((start == tokenizer.position) && ch == '-') {
+      tokenizer.position++;
     } else if (is_digit(ch)) {
-      position++;
-    } else if ((start == position-1) && ch == 'x') {
+      tokenizer.position++;
+    } else if ((start == tokenizer.position-1) && ch == 'x') {
       is_hex = true;
-      position++;
+      tokenizer.position++;
     } else if (is_hex && is_hex_digit(ch)) {
-      position++;
+      tokenizer.position++;
     } else {
       break;
     }
@@ -125,52 +135,60 @@ void read_number()
 
   extract_lit(start);
   if (is_hex) {
-    lookahead_token = HEXINTEGER;
+    tokenizer.lookahead_token = HEXINTEGER;
   } else {
-    lookahead_token = INTEGER;
+    tokenizer.lookahead_token = INTEGER;
   }
 }
 
 
 void read_string()
 {
-  int start = ++position;
-  while (!is_eof() && source[position] != '\"') {
-    if (source[position] == '\\') {
-      position++;
+  int start = ++tokenizer.position;
+  while (!is_eof() && tokenizer.source[tokenizer.position] != '\"') {
+    if (tokenizer.source[tokenizer.position] == '\\') {
+      tokenizer.position++;
     }
-    position++;
+    if (tokenizer.source[tokenizer.position] == '\n') {
+      tokenizer.line++;
+    }
+    tokenizer.position++;
   }
   if (is_eof()) {
-    lookahead_token = END_OF_FILE;
-    lookahead_lit = "";
+    tokenizer.lookahead_token = END_OF_FILE;
+    tokenizer.lookahead_lit = "";
     return;
   }
   extract_lit(start);
-  position++;
-  lookahead_token = STRING;
+  tokenizer.position++;
+  tokenizer.lookahead_token = STRING;
 }
 
 
 void read_next_token(void)
 {
   if (is_eof()) {           /* handle END_OF_FILE */
-    lookahead_token = END_OF_FILE;
-    lookahead_lit = "";
+    tokenizer.lookahead_token = END_OF_FILE;
+    tokenizer.lookahead_lit = "";
     return;
   }
-  while (is_space(source[position])) { /* consume whitespace */
-    position++;
+  while (is_space(tokenizer.source[tokenizer.position])) { /* consume whitespace */
+    if (tokenizer.source[tokenizer.position] == '\n') {
+      tokenizer.line++;
+    }
+    tokenizer.position++;
     if (is_eof()) {
-      lookahead_token = END_OF_FILE;
-      lookahead_lit = "";
+      tokenizer.lookahead_token = END_OF_FILE;
+      tokenizer.lookahead_lit = "";
+      return;
     }
   }
 
-  char current_char = source[position];
+  tokenizer.lookahead_line = tokenizer.line;
+  char current_char = tokenizer.source[tokenizer.position];
   char next_char = 0;
   if (!is_almost_eof()) {
-    next_char = source[position+1];
+    next_char = tokenizer.source[tokenizer.position+1];
   }
   if (is_letter(current_char) || current_char == '_') {
     read_symbol();
@@ -183,137 +201,137 @@ void read_next_token(void)
   } else if (current_char == '\"') {
     read_string();
   } else if (current_char == '\'') {
-    position++;
-    lookahead_token = QUOTE;
-    lookahead_lit = "'";
+    tokenizer.position++;
+    tokenizer.lookahead_token = QUOTE;
+    tokenizer.lookahead_lit = "'";
   } else if (current_char == '`') {
-    position++;
-    lookahead_token = BACKQUOTE;
-    lookahead_lit = "`";
+    tokenizer.position++;
+    tokenizer.lookahead_token = BACKQUOTE;
+    tokenizer.lookahead_lit = "`";
   } else if (current_char == ',' && next_char == '@') {
-    position += 2;
-    lookahead_token = COMMAAT;
-    lookahead_lit = ",@";
+    tokenizer.position += 2;
+    tokenizer.lookahead_token = COMMAAT;
+    tokenizer.lookahead_lit = ",@";
   } else if (current_char == ',') {
-    position++;
-    lookahead_token = COMMA;
-    lookahead_lit = ",";
+    tokenizer.position++;
+    tokenizer.lookahead_token = COMMA;
+    tokenizer.lookahead_lit = ",";
   } else if (current_char == '(') {
-    position++;
-    lookahead_token = LPAREN;
-    lookahead_lit = "(";
+    tokenizer.position++;
+    tokenizer.lookahead_token = LPAREN;
+    tokenizer.lookahead_lit = "(";
   } else if (current_char == ')') {
-    position++;
-    lookahead_token = RPAREN;
-    lookahead_lit = ")";
+    tokenizer.position++;
+    tokenizer.lookahead_token = RPAREN;
+    tokenizer.lookahead_lit = ")";
   } else if (current_char == '[') {
-    position++;
-    lookahead_token = LBRACKET;
-    lookahead_lit = "[";
+    tokenizer.position++;
+    tokenizer.lookahead_token = LBRACKET;
+    tokenizer.lookahead_lit = "[";
   } else if (current_char == ']') {
-    position++;
-    lookahead_token = RBRACKET;
-    lookahead_lit = "]";
+    tokenizer.position++;
+    tokenizer.lookahead_token = RBRACKET;
+    tokenizer.lookahead_lit = "]";
   } else if (current_char == '{') {
-    position++;
-    lookahead_token = LBRACE;
-    lookahead_lit = "{";
+    tokenizer.position++;
+    tokenizer.lookahead_token = LBRACE;
+    tokenizer.lookahead_lit = "{";
   } else if (current_char == '}') {
-    position++;
-    lookahead_token = RBRACE;
-    lookahead_lit = "}";
+    tokenizer.position++;
+    tokenizer.lookahead_token = RBRACE;
+    tokenizer.lookahead_lit = "}";
   } else if (current_char == '.') {
-    position++;
-    lookahead_token = PERIOD;
-    lookahead_lit = ".";
+    tokenizer.position++;
+    tokenizer.lookahead_token = PERIOD;
+    tokenizer.lookahead_lit = ".";
   } else if (current_char == '-' && next_char == '>') {
-    position += 2;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "->";
+    tokenizer.position += 2;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "->";
   } else if (current_char == '=' && next_char == '>') {
-    position += 2;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "=>";
+    tokenizer.position += 2;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "=>";
   } else if (current_char == '+') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "+";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "+";
   } else if (current_char == '-') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "-";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "-";
   } else if (current_char == '*') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "*";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "*";
   } else if (current_char == '/') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "/";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "/";
   } else if (current_char == '%') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "%";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "%";
   } else if (current_char == '<' && next_char == '=') {
-    position += 2;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "<=";
+    tokenizer.position += 2;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "<=";
   } else if (current_char == '<') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "<";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "<";
   } else if (current_char == '>' && next_char == '=') {
-    position += 2;
-    lookahead_token = SYMBOL;
-    lookahead_lit = ">=";
+    tokenizer.position += 2;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = ">=";
   } else if (current_char == '>') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = ">";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = ">";
   } else if (current_char == '=' && next_char == '=') {
-    position += 2;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "==";
+    tokenizer.position += 2;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "==";
   } else if (current_char == '=') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "=";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "=";
   } else if (current_char == '!' && next_char == '=') {
-    position += 2;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "!=";
+    tokenizer.position += 2;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "!=";
   } else if (current_char == '!') {
-    position++;
-    lookahead_token = SYMBOL;
-    lookahead_lit = "!";
+    tokenizer.position++;
+    tokenizer.lookahead_token = SYMBOL;
+    tokenizer.lookahead_lit = "!";
   } else if (current_char == '#') {
-    position += 2;
+    tokenizer.position += 2;
     if (next_char == 't') {
-      lookahead_token = TRUE;
-      lookahead_lit = "#t";
+      tokenizer.lookahead_token = TRUE;
+      tokenizer.lookahead_lit = "#t";
     } else {
-      lookahead_token = FALSE;
-      lookahead_lit = "#f";
+      tokenizer.lookahead_token = FALSE;
+      tokenizer.lookahead_lit = "#f";
     }
   } else if (current_char == ';') {
-    int start = position;
+    int start = tokenizer.position;
     while (1) {
       if (is_eof()) {
-        lookahead_token = COMMENT;
+        tokenizer.lookahead_token = COMMENT;
         extract_lit(start);
         return;
-      } else if (source[position] == '\n') {
-        lookahead_token = COMMENT;
+      } else if (tokenizer.source[tokenizer.position] == '\n') {
+        tokenizer.lookahead_token = COMMENT;
         extract_lit(start);
         return;
       }
-      position++;
+      tokenizer.position++;
     }
   } else {
-    lookahead_token = ILLEGAL;
-    lookahead_lit = malloc(2);
-    lookahead_lit[0] = current_char;
-    lookahead_lit[1] = '\0';
+    tokenizer.lookahead_token = ILLEGAL;
+    tokenizer.lookahead_lit = malloc(2);
+    tokenizer.lookahead_lit[0] = current_char;
+    tokenizer.lookahead_lit[1] = '\0';
   }
 }
 
@@ -321,7 +339,7 @@ void read_next_token(void)
 void consume_token(void)
 {
   read_next_token();
-  if (lookahead_token == COMMENT) {
+  if (tokenizer.lookahead_token == COMMENT) {
     consume_token();
   }
 }
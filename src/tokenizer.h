@@ -31,9 +31,21 @@ typedef enum {
   END_OF_FILE
 } token_t;
 
+/* Where the tokenizer is in its source; each interpreter has its own */
+
+typedef struct tokenizer_state_t {
+  token_t lookahead_token;
+  char *lookahead_lit;
+  char *source;
+  int position;
+  int line;
+  int lookahead_line;
+} tokenizer_state_t;
+
 void initialize_tokenizer(char *src_string);
 token_t get_token(void);
 char *get_lit(void);
+int get_line(void);
 void consume_token(void);
 
 #define __TOKENIZER_H
@@ -0,0 +1,138 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the Chrome trace event writer. */
+
+/* Events are written in the trace event JSON format that chrome://tracing,
+   Perfetto and speedscope load: a begin (B) and end (E) event around each
+   application and macro expansion, and an instant (i) event for each
+   environment frame created.  Timestamps are microseconds since tracing
+   started.  Events are formatted into a buffer that is written out when it
+   fills, so tracing does not go through the logger. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "tracer.h"
+
+#define TRACE_BUFFER_SIZE (64 * 1024)
+#define MAX_TRACE_EVENT_LENGTH 2048
+#define MAX_TRACE_NAME_LENGTH 200
+
+bool tracing = false;
+
+static FILE *trace_file = NULL;
+static char trace_buffer[TRACE_BUFFER_SIZE];
+static int trace_used = 0;
+static bool first_event = true;
+static struct timespec trace_epoch;
+
+
+static void flush_trace(void)
+{
+  fwrite(trace_buffer, 1, trace_used, trace_file);
+  trace_used = 0;
+}
+
+
+static double trace_timestamp(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - trace_epoch.tv_sec) * 1e6 + (now.tv_nsec - trace_epoch.tv_nsec) / 1e3;
+}
+
+
+/* Copies name into the buffer as the body of a JSON string */
+
+static char *escape_name(char *out, char *name)
+{
+  for (int i = 0; name[i] != '\0' && i < MAX_TRACE_NAME_LENGTH; i++) {
+    char c = name[i];
+    if (c == '"' || c == '\\') {
+      *out++ = '\\';
+      *out++ = c;
+    } else if ((unsigned char)c < ' ') {
+      out += sprintf(out, "\\u%04x", c);
+    } else {
+      *out++ = c;
+    }
+  }
+  return out;
+}
+
+
+static void write_event(char *name, char *category, char phase)
+{
+  if (trace_used > TRACE_BUFFER_SIZE - MAX_TRACE_EVENT_LENGTH) {
+    flush_trace();
+  }
+  char *out = trace_buffer + trace_used;
+  if (!first_event) {
+    *out++ = ',';
+  }
+  first_event = false;
+  out += sprintf(out, "\n{\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":1", phase, trace_timestamp());
+  if (name != NULL) {
+    out += sprintf(out, ",\"name\":\"");
+    out = escape_name(out, name);
+    out += sprintf(out, "\",\"cat\":\"%s\"", category);
+  }
+  if (phase == 'i') {
+    out += sprintf(out, ",\"s\":\"t\"");
+  }
+  *out++ = '}';
+  trace_used = out - trace_buffer;
+}
+
+
+bool trace_start(char *filename, char **err_ptr)
+{
+  trace_file = fopen(filename, "w");
+  if (trace_file == NULL) {
+    char *buf = (char*)malloc((48 + strlen(filename)) * sizeof(char));
+    sprintf(buf, "Could not open %s for the trace", filename);
+    *err_ptr = buf;
+    return false;
+  }
+  fprintf(trace_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+  first_event = true;
+  trace_used = 0;
+  tracing = true;
+  return true;
+}
+
+
+void trace_stop(void)
+{
+  if (!tracing) {
+    return;
+  }
+  tracing = false;
+  flush_trace();
+  fprintf(trace_file, "\n]}\n");
+  fclose(trace_file);
+  trace_file = NULL;
+}
+
+
+void trace_begin(char *name, char *category)
+{
+  write_event(name, category, 'B');
+}
+
+
+void trace_end(void)
+{
+  write_event(NULL, NULL, 'E');
+}
+
+
+void trace_instant(char *name, char *category)
+{
+  write_event(name, category, 'i');
+}
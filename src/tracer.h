@@ -0,0 +1,23 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the Chrome trace event writer. */
+
+#ifndef __TRACER_H
+#define __TRACER_H
+
+#include <stdbool.h>
+
+/* Checked before each event; when false tracing costs one branch */
+
+extern bool tracing;
+
+bool trace_start(char *filename, char **err_ptr);
+void trace_stop(void);
+void trace_begin(char *name, char *category);
+void trace_end(void);
+void trace_instant(char *name, char *category);
+
+#endif
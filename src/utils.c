@@ -45,7 +45,8 @@ data_t *vector_to_list_with_tail(Vector *v, data_t *tail) {
   }
   retain(tail);
   last_cell(head)->data.pair.cdr_ptr = tail;
-  data_t *result = cdr(head);
+  /* The first cell was retained as the head's cdr; hand it back floating */
+  data_t *result = disown(cdr(head));
   free_data(head);
   return result;
 }
@@ -0,0 +1,20 @@
+; One value stored in many persistent vector and map nodes: each copied
+; path retains it again, which used to wrap its 12 bit count and free it
+; while still referenced.
+; expected: 6
+
+(define s "abc")
+
+(define (push n v)
+  (if (eq? n 0)
+      v
+      (push (- n 1) (vector-push v s))))
+
+(define (assoc-n n m)
+  (if (eq? n 0)
+      m
+      (assoc-n (- n 1) (hash-map-assoc m n s))))
+
+(define v (push 300 (vector)))
+(define m (assoc-n 500 (hash-map)))
+(string-length (string-append (vector-ref v 299) (hash-map-ref m 499 "")))
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Runs every regression test in this directory. Like the benchmarks, each
+# test file names its expected result on a "; expected:" line.
+#
+# usage: run_tests.sh <zombielisp binary>
+
+binary="$1"
+dir=$(dirname "$0")
+status=0
+
+if [ -z "$binary" ]; then
+    echo "usage: $0 <zombielisp binary>" >&2
+    exit 2
+fi
+
+for file in "$dir"/*.scm; do
+    name=$(basename "$file" .scm)
+    expected=$(sed -n 's/^; expected: //p' "$file")
+    output=$("$binary" -s -f "$file" 2>&1)
+    if [ $? -ne 0 ]; then
+        echo "$name: exited with failure"
+        status=1
+        continue
+    fi
+    result=$(echo "$output" | tail -n 2 | head -n 1)
+    if [ "$result" = "$expected" ]; then
+        echo "$name: ok"
+    else
+        echo "$name: expected $expected, got $result"
+        status=1
+    fi
+done
+
+exit $status
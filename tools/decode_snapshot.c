@@ -0,0 +1,492 @@
+/* Copyright 2015 Dave Astels.  All rights reserved. */
+/* Use of this source code is governed by a BSD-style */
+/* license that can be found in the LICENSE file. */
+
+/* This package implements a basic LISP interpretor for the ARM Cortex M4 */
+/* This file contains the host side decoder for heap snapshots written by
+   (heap-snapshot "file"). */
+
+/* It prints a histogram of cells by type, what is unreachable from the
+   roots, and the nodes that retain the most cells.  A node retains the
+   cells it dominates: those every path from the roots passes through it to
+   reach.  Dominators are found with the iterative algorithm of Cooper,
+   Harvey and Kennedy over a reverse postorder of the graph.
+
+   usage: decode-snapshot [-n count] [-d] snapshot-file
+     -n  how many of the largest retainers to list (default 20)
+     -d  also dump every node with its edges */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#define FRAME_TYPE -1
+#define NO_NODE -1
+
+typedef struct node_t {
+  bool present;
+  int type;
+  int refs;
+  int parent;
+  int edge_count;
+  int *edges;
+} node_t;
+
+typedef struct snapshot_t {
+  int cell_size;
+  int total_cells;
+  int number_of_types;
+  char **type_names;
+  int number_of_cells;
+  int number_of_frames;
+  int number_of_nodes;
+  node_t *nodes;
+  int number_of_roots;
+  int *roots;
+} snapshot_t;
+
+FILE *in;
+
+
+void fail(char *message)
+{
+  fprintf(stderr, "decode-snapshot: %s\n", message);
+  exit(1);
+}
+
+
+int read_byte(void)
+{
+  int c = fgetc(in);
+  if (c == EOF) {
+    fail("snapshot is truncated");
+  }
+  return c;
+}
+
+
+uint32_t read_varint(void)
+{
+  uint32_t value = 0;
+  int shift = 0;
+  int byte;
+  do {
+    byte = read_byte();
+    value |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+
+char *type_label(snapshot_t *s, int type)
+{
+  if (type == FRAME_TYPE) {
+    return "frame";
+  }
+  if (type >= 0 && type < s->number_of_types) {
+    return s->type_names[type];
+  }
+  return "??";
+}
+
+
+/********************************************************************************/
+/* reading                                                                      */
+/********************************************************************************/
+
+void read_header(snapshot_t *s)
+{
+  char magic[5] = {0};
+  for (int i = 0; i < 4; i++) {
+    magic[i] = read_byte();
+  }
+  if (strcmp(magic, "ZLHS") != 0) {
+    fail("not a heap snapshot");
+  }
+  int version = read_byte();
+  if (version != 1) {
+    fail("unsupported snapshot version");
+  }
+  s->cell_size = read_varint();
+  s->total_cells = read_varint();
+  s->number_of_types = read_varint();
+  s->type_names = (char**)malloc(s->number_of_types * sizeof(char*));
+  for (int i = 0; i < s->number_of_types; i++) {
+    int length = read_varint();
+    s->type_names[i] = (char*)malloc(length + 1);
+    for (int j = 0; j < length; j++) {
+      s->type_names[i][j] = read_byte();
+    }
+    s->type_names[i][length] = '\0';
+  }
+}
+
+
+/* Node ids of frames are only bounded by the frame registry, so the node
+   table grows as they are read */
+
+node_t *node_at(snapshot_t *s, int id)
+{
+  if (id < 0) {
+    fail("bad node id");
+  }
+  if (id >= s->number_of_nodes) {
+    int capacity = (id + 1) * 2;
+    s->nodes = (node_t*)realloc(s->nodes, capacity * sizeof(node_t));
+    memset(s->nodes + s->number_of_nodes, 0, (capacity - s->number_of_nodes) * sizeof(node_t));
+    s->number_of_nodes = capacity;
+  }
+  return &s->nodes[id];
+}
+
+
+void read_edges(node_t *node)
+{
+  node->edge_count = read_varint();
+  node->edges = (int*)malloc(node->edge_count * sizeof(int));
+  for (int i = 0; i < node->edge_count; i++) {
+    node->edges[i] = read_varint();
+  }
+}
+
+
+void read_snapshot(snapshot_t *s)
+{
+  memset(s, 0, sizeof(snapshot_t));
+  read_header(s);
+  node_at(s, s->total_cells);
+
+  s->number_of_cells = read_varint();
+  for (int i = 0; i < s->number_of_cells; i++) {
+    node_t *node = node_at(s, read_varint());
+    node->present = true;
+    node->type = read_byte();
+    node->refs = read_varint();
+    node->parent = NO_NODE;
+    read_edges(node);
+  }
+
+  s->number_of_frames = read_varint();
+  for (int i = 0; i < s->number_of_frames; i++) {
+    node_t *node = node_at(s, read_varint());
+    node->present = true;
+    node->type = FRAME_TYPE;
+    node->parent = (int)read_varint() - 1;
+    read_edges(node);
+  }
+
+  s->number_of_roots = read_varint();
+  s->roots = (int*)malloc(s->number_of_roots * sizeof(int));
+  for (int i = 0; i < s->number_of_roots; i++) {
+    s->roots[i] = read_varint();
+  }
+
+  /* Make sure every edge target has a slot, present or not */
+  for (int id = 0; id < s->number_of_nodes; id++) {
+    for (int i = 0; i < s->nodes[id].edge_count; i++) {
+      node_at(s, s->nodes[id].edges[i]);
+    }
+  }
+}
+
+
+/********************************************************************************/
+/* analysis                                                                     */
+/********************************************************************************/
+
+/* The graph gets a virtual root, numbered after every node, whose edges
+   are the snapshot's roots.  A frame's parent counts as an edge since the
+   frame keeps it alive. */
+
+int edge_count_of(snapshot_t *s, int id)
+{
+  if (id == s->number_of_nodes) {
+    return s->number_of_roots;
+  }
+  node_t *node = &s->nodes[id];
+  return node->edge_count + (node->type == FRAME_TYPE && node->parent != NO_NODE);
+}
+
+
+int edge_of(snapshot_t *s, int id, int i)
+{
+  if (id == s->number_of_nodes) {
+    return s->roots[i];
+  }
+  node_t *node = &s->nodes[id];
+  return (i < node->edge_count) ? node->edges[i] : node->parent;
+}
+
+
+/* Iterative depth first search giving the postorder number of each reached
+   node, or -1 */
+
+int *postorder_from_root(snapshot_t *s, int **order_ptr, int *reached_ptr)
+{
+  int count = s->number_of_nodes + 1;
+  int *number = (int*)malloc(count * sizeof(int));
+  int *order = (int*)malloc(count * sizeof(int));
+  int *stack = (int*)malloc(count * sizeof(int));
+  int *next_edge = (int*)calloc(count, sizeof(int));
+  bool *seen = (bool*)calloc(count, sizeof(bool));
+  for (int i = 0; i < count; i++) {
+    number[i] = -1;
+  }
+
+  int depth = 0;
+  int reached = 0;
+  stack[depth++] = s->number_of_nodes;
+  seen[s->number_of_nodes] = true;
+  while (depth > 0) {
+    int id = stack[depth - 1];
+    if (next_edge[id] < edge_count_of(s, id)) {
+      int target = edge_of(s, id, next_edge[id]++);
+      if (target >= 0 && target < s->number_of_nodes && s->nodes[target].present && !seen[target]) {
+        seen[target] = true;
+        stack[depth++] = target;
+      }
+    } else {
+      depth--;
+      number[id] = reached;
+      order[reached++] = id;
+    }
+  }
+
+  free(stack);
+  free(next_edge);
+  free(seen);
+  *order_ptr = order;
+  *reached_ptr = reached;
+  return number;
+}
+
+
+int intersect(int *idom, int *number, int a, int b)
+{
+  while (a != b) {
+    while (number[a] < number[b]) {
+      a = idom[a];
+    }
+    while (number[b] < number[a]) {
+      b = idom[b];
+    }
+  }
+  return a;
+}
+
+
+/* Returns the immediate dominator of every reached node */
+
+int *dominators(snapshot_t *s, int *number, int *order, int reached)
+{
+  int count = s->number_of_nodes + 1;
+  int root = s->number_of_nodes;
+
+  /* Predecessor lists in one array, indexed through offsets */
+  int *predecessor_count = (int*)calloc(count + 1, sizeof(int));
+  for (int k = 0; k < reached; k++) {
+    int id = order[k];
+    for (int i = 0; i < edge_count_of(s, id); i++) {
+      int target = edge_of(s, id, i);
+      if (target >= 0 && target < s->number_of_nodes && number[target] != -1) {
+        predecessor_count[target + 1]++;
+      }
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    predecessor_count[i + 1] += predecessor_count[i];
+  }
+  int *predecessors = (int*)malloc(((size_t)predecessor_count[count] + 1) * sizeof(int));
+  int *filled = (int*)calloc(count + 1, sizeof(int));
+  for (int k = 0; k < reached; k++) {
+    int id = order[k];
+    for (int i = 0; i < edge_count_of(s, id); i++) {
+      int target = edge_of(s, id, i);
+      if (target >= 0 && target < s->number_of_nodes && number[target] != -1) {
+        predecessors[predecessor_count[target] + filled[target]++] = id;
+      }
+    }
+  }
+
+  int *idom = (int*)malloc(count * sizeof(int));
+  for (int i = 0; i < count; i++) {
+    idom[i] = NO_NODE;
+  }
+  idom[root] = root;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int k = reached - 2; k >= 0; k--) {
+      int id = order[k];
+      int new_idom = NO_NODE;
+      for (int p = predecessor_count[id]; p < predecessor_count[id + 1]; p++) {
+        int predecessor = predecessors[p];
+        if (idom[predecessor] == NO_NODE) {
+          continue;
+        }
+        new_idom = (new_idom == NO_NODE) ? predecessor : intersect(idom, number, predecessor, new_idom);
+      }
+      if (idom[id] != new_idom) {
+        idom[id] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  free(predecessor_count);
+  free(predecessors);
+  free(filled);
+  return idom;
+}
+
+
+/********************************************************************************/
+/* reporting                                                                    */
+/********************************************************************************/
+
+int *retained_cells;
+
+
+int by_retained(const void *a, const void *b)
+{
+  int x = *(int*)a, y = *(int*)b;
+  if (retained_cells[x] != retained_cells[y]) {
+    return (retained_cells[x] > retained_cells[y]) ? -1 : 1;
+  }
+  return x - y;
+}
+
+
+void print_histogram(snapshot_t *s, int *number)
+{
+  int types = s->number_of_types;
+  long *count = (long*)calloc(types, sizeof(long));
+  long *refs = (long*)calloc(types, sizeof(long));
+  long *unreachable = (long*)calloc(types, sizeof(long));
+  for (int id = 0; id < s->total_cells && id < s->number_of_nodes; id++) {
+    node_t *node = &s->nodes[id];
+    if (node->present && node->type < types) {
+      count[node->type]++;
+      refs[node->type] += node->refs;
+      unreachable[node->type] += number[id] == -1;
+    }
+  }
+  printf("%-6s %10s %12s %12s %12s\n", "type", "cells", "bytes", "refcounts", "unreachable");
+  for (int type = 0; type < types; type++) {
+    if (count[type] > 0) {
+      printf("%-6s %10ld %12ld %12ld %12ld\n", type_label(s, type), count[type], count[type] * s->cell_size, refs[type], unreachable[type]);
+    }
+  }
+  free(count);
+  free(refs);
+  free(unreachable);
+}
+
+
+void print_retainers(snapshot_t *s, int *idom, int *order, int reached, int limit)
+{
+  int root = s->number_of_nodes;
+  retained_cells = (int*)calloc(s->number_of_nodes + 1, sizeof(int));
+  for (int k = 0; k < reached; k++) {
+    int id = order[k];
+    if (id != root && id < s->total_cells) {
+      retained_cells[id]++;
+    }
+  }
+  /* Postorder visits every node before its dominator */
+  for (int k = 0; k < reached; k++) {
+    int id = order[k];
+    if (id != root && idom[id] != NO_NODE && idom[id] != root) {
+      retained_cells[idom[id]] += retained_cells[id];
+    }
+  }
+
+  int *ids = (int*)malloc(reached * sizeof(int));
+  int count = 0;
+  for (int k = 0; k < reached; k++) {
+    if (order[k] != root) {
+      ids[count++] = order[k];
+    }
+  }
+  qsort(ids, count, sizeof(int), &by_retained);
+
+  printf("\n%10s %12s  %-6s %s\n", "retained", "bytes", "type", "node");
+  for (int i = 0; i < count && i < limit; i++) {
+    int id = ids[i];
+    printf("%10d %12ld  %-6s %d\n", retained_cells[id], (long)retained_cells[id] * s->cell_size, type_label(s, s->nodes[id].type), id);
+  }
+  free(ids);
+  free(retained_cells);
+}
+
+
+void dump_nodes(snapshot_t *s)
+{
+  printf("\n");
+  for (int id = 0; id < s->number_of_nodes; id++) {
+    node_t *node = &s->nodes[id];
+    if (!node->present) {
+      continue;
+    }
+    printf("%d %s", id, type_label(s, node->type));
+    if (node->type != FRAME_TYPE) {
+      printf(" refs %d", node->refs);
+    } else if (node->parent != NO_NODE) {
+      printf(" parent %d", node->parent);
+    }
+    printf(" ->");
+    for (int i = 0; i < node->edge_count; i++) {
+      printf(" %d", node->edges[i]);
+    }
+    printf("\n");
+  }
+}
+
+
+int main(int argc, char *argv[])
+{
+  int limit = 20;
+  bool dump = false;
+  int c;
+  while ((c = getopt(argc, argv, "n:d")) != -1) {
+    switch (c) {
+    case 'n':
+      limit = atoi(optarg);
+      break;
+    case 'd':
+      dump = true;
+      break;
+    default:
+      fail("usage: decode-snapshot [-n count] [-d] snapshot-file");
+    }
+  }
+  if (optind >= argc) {
+    fail("usage: decode-snapshot [-n count] [-d] snapshot-file");
+  }
+  in = fopen(argv[optind], "rb");
+  if (in == NULL) {
+    fail("could not open the snapshot");
+  }
+
+  snapshot_t s;
+  read_snapshot(&s);
+  fclose(in);
+
+  int *order;
+  int reached;
+  int *number = postorder_from_root(&s, &order, &reached);
+  int *idom = dominators(&s, number, order, reached);
+
+  printf("%d of %d cells live, %d bytes each, %d frames, %d roots\n\n",
+         s.number_of_cells, s.total_cells, s.cell_size, s.number_of_frames, s.number_of_roots);
+  print_histogram(&s, number);
+  print_retainers(&s, idom, order, reached, limit);
+  if (dump) {
+    dump_nodes(&s);
+  }
+  return 0;
+}